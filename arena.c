@@ -0,0 +1,223 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "harness.h"
+
+/* Chunk payload sizes grow geometrically between these bounds, so that a
+ * handful of elements costs a small chunk while large queues amortize the
+ * allocation over many elements.
+ */
+#define ARENA_MIN_CHUNK 1024
+#define ARENA_MAX_CHUNK (256 * 1024)
+
+/* Layout of a released object while it sits on a free list. Objects are at
+ * least ARENA_ALIGN bytes long, so both pointers always fit.
+ */
+typedef struct __arena_slot {
+    struct __arena_slot *next;
+    arena_chunk_t *chunk;
+} arena_slot_t;
+
+/* Objects of 1..16 bytes go to class 0, 17..32 bytes to class 1, and so on */
+static inline int size_class(size_t size)
+{
+    return (int) ((size - 1) / ARENA_ALIGN);
+}
+
+static arena_chunk_t *chunk_new(arena_t *a, size_t size)
+{
+    arena_chunk_t *c = malloc(sizeof(arena_chunk_t) + size);
+    if (!c)
+        return NULL;
+
+    c->arena = a;
+    c->size = size;
+    list_add(&c->node, &a->chunks);
+    return c;
+}
+
+/* Reset the string pool of @a, whose chunks must have been moved away */
+static void pool_init(arena_t *a)
+{
+    INIT_LIST_HEAD(&a->pool);
+    a->pool_cursor = NULL;
+    a->pool_avail = 0;
+    a->pool_next = ARENA_MIN_CHUNK;
+    a->pool_live = 0;
+}
+
+void arena_init(arena_t *a)
+{
+    INIT_LIST_HEAD(&a->chunks);
+    for (int i = 0; i < ARENA_CLASSES; i++)
+        a->slots[i] = NULL;
+    a->current = NULL;
+    a->cursor = NULL;
+    a->avail = 0;
+    a->next_size = ARENA_MIN_CHUNK;
+    pool_init(a);
+}
+
+void *arena_alloc(arena_t *a, size_t size, arena_chunk_t **chunk)
+{
+    /* Oversized objects live in a chunk of their own */
+    if (size > ARENA_MAX_OBJECT) {
+        arena_chunk_t *c = chunk_new(a, size);
+        if (!c)
+            return NULL;
+        *chunk = c;
+        return c->data;
+    }
+
+    int cls = size_class(size);
+    arena_slot_t *slot = a->slots[cls];
+    if (slot) {
+        a->slots[cls] = slot->next;
+        *chunk = slot->chunk;
+        return slot;
+    }
+
+    size = arena_round_up(size);
+    if (a->avail < size) {
+        arena_chunk_t *c = chunk_new(a, a->next_size);
+        if (!c)
+            return NULL;
+        a->current = c;
+        a->cursor = c->data;
+        a->avail = c->size;
+        if (a->next_size < ARENA_MAX_CHUNK)
+            a->next_size <<= 1;
+    }
+
+    void *p = a->cursor;
+    a->cursor += size;
+    a->avail -= size;
+    *chunk = a->current;
+    return p;
+}
+
+void *arena_alloc_block(arena_t *a, size_t size, arena_chunk_t **chunk)
+{
+    size = arena_round_up(size);
+    if (a->avail >= size) {
+        void *p = a->cursor;
+        a->cursor += size;
+        a->avail -= size;
+        *chunk = a->current;
+        return p;
+    }
+
+    /* A chunk sized for the block alone, the bump region stays where it is */
+    arena_chunk_t *c = chunk_new(a, size);
+    if (!c)
+        return NULL;
+    *chunk = c;
+    return c->data;
+}
+
+void arena_free(arena_chunk_t *chunk, void *p, size_t size)
+{
+    if (size > ARENA_MAX_OBJECT) {
+        list_del(&chunk->node);
+        free(chunk);
+        return;
+    }
+
+    arena_t *a = chunk->arena;
+    int cls = size_class(size);
+    arena_slot_t *slot = p;
+    slot->next = a->slots[cls];
+    slot->chunk = chunk;
+    a->slots[cls] = slot;
+}
+
+/* Add a string chunk of @size bytes to @a and append from it from now on */
+static bool pool_grow(arena_t *a, size_t size)
+{
+    arena_chunk_t *c = malloc(sizeof(arena_chunk_t) + size);
+    if (!c)
+        return false;
+
+    c->arena = a;
+    c->size = size;
+    list_add_tail(&c->node, &a->pool);
+    a->pool_cursor = c->data;
+    a->pool_avail = size;
+    return true;
+}
+
+char *arena_strdup(arena_t *a, const char *s, size_t len)
+{
+    if (a->pool_avail <= len) {
+        size_t size = a->pool_next > len ? a->pool_next : len + 1;
+        if (!pool_grow(a, size))
+            return NULL;
+        if (a->pool_next < ARENA_MAX_CHUNK)
+            a->pool_next <<= 1;
+    }
+
+    char *p = memcpy(a->pool_cursor, s, len);
+    p[len] = '\0';
+    a->pool_cursor += len + 1;
+    a->pool_avail -= len + 1;
+    a->pool_live += len + 1;
+    return p;
+}
+
+bool arena_pool_renew(arena_t *a, size_t size, struct list_head *old)
+{
+    LIST_HEAD(pool);
+    list_splice_init(&a->pool, &pool);
+    char *cursor = a->pool_cursor;
+    size_t avail = a->pool_avail, live = a->pool_live;
+
+    /* The live bytes are counted again as the strings are copied back */
+    a->pool_cursor = NULL;
+    a->pool_avail = 0;
+    a->pool_live = 0;
+    if (size && !pool_grow(a, size)) {
+        list_splice(&pool, &a->pool);
+        a->pool_cursor = cursor;
+        a->pool_avail = avail;
+        a->pool_live = live;
+        return false;
+    }
+    list_splice_tail(&pool, old);
+    return true;
+}
+
+void arena_pool_drop(struct list_head *old)
+{
+    arena_chunk_t *c, *safe;
+    list_for_each_entry_safe (c, safe, old, node)
+        free(c);
+    INIT_LIST_HEAD(old);
+}
+
+void arena_adopt(arena_t *dst, arena_t *src)
+{
+    arena_chunk_t *c;
+    list_for_each_entry (c, &src->chunks, node)
+        c->arena = dst;
+
+    /* The bump region and the free slots of @src are given up rather than
+     * merged; the memory is still owned by the moved chunks and comes back
+     * when @dst is destroyed.
+     */
+    list_splice_tail_init(&src->chunks, &dst->chunks);
+    list_for_each_entry (c, &src->pool, node)
+        c->arena = dst;
+    list_splice_init(&src->pool, &dst->pool);
+    dst->pool_live += src->pool_live;
+    arena_init(src);
+}
+
+void arena_destroy(arena_t *a)
+{
+    arena_chunk_t *c, *safe;
+    list_for_each_entry_safe (c, safe, &a->chunks, node)
+        free(c);
+    arena_pool_drop(&a->pool);
+    arena_init(a);
+}
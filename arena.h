@@ -0,0 +1,180 @@
+#ifndef LAB0_ARENA_H
+#define LAB0_ARENA_H
+
+/* Slab arena backing the elements of a queue.
+ *
+ * Objects are carved out of large chunks obtained from malloc, recycled
+ * through per-size-class free lists when released, and returned to malloc
+ * all at once when the arena is destroyed. Objects larger than the biggest
+ * size class get a chunk of their own, which is given back as soon as the
+ * object is released.
+ *
+ * The arena also holds an append-only pool of strings, in chunks of their
+ * own. Strings are copied back to back and never reused individually: the
+ * space of released ones is only recovered when the live strings are moved
+ * to a fresh chunk with arena_pool_renew().
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "list.h"
+
+/* Objects are rounded up to multiples of ARENA_ALIGN bytes */
+#define ARENA_ALIGN 16
+
+/* Number of size classes, covering objects up to 256 bytes */
+#define ARENA_CLASSES 16
+
+/* Objects larger than this get a chunk of their own */
+#define ARENA_MAX_OBJECT (ARENA_CLASSES * ARENA_ALIGN)
+
+/* Round @size up to the granularity objects are carved at */
+static inline size_t arena_round_up(size_t size)
+{
+    return (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+}
+
+/**
+ * arena_chunk_t - A block of memory objects are carved from
+ * @node: node in the chunk list of the owning arena
+ * @arena: the arena currently owning this chunk
+ * @size: number of usable bytes in @data
+ * @data: storage for the objects
+ */
+typedef struct __arena_chunk {
+    struct list_head node;
+    struct __arena *arena;
+    size_t size;
+    char data[] __attribute__((aligned(ARENA_ALIGN)));
+} arena_chunk_t;
+
+/**
+ * arena_t - Per-queue slab arena
+ * @chunks: list of chunks owned by this arena
+ * @slots: heads of the free lists, one per size class
+ * @current: the chunk new objects are carved from
+ * @cursor: next unused byte in @current
+ * @avail: number of unused bytes behind @cursor
+ * @next_size: payload size of the next chunk to be allocated
+ * @pool: list of chunks holding strings, see arena_strdup()
+ * @pool_cursor: next unused byte in the newest string chunk
+ * @pool_avail: number of unused bytes behind @pool_cursor
+ * @pool_next: payload size of the next string chunk to be allocated
+ * @pool_live: number of bytes taken by the strings not released yet
+ */
+typedef struct __arena {
+    struct list_head chunks;
+    void *slots[ARENA_CLASSES];
+    arena_chunk_t *current;
+    char *cursor;
+    size_t avail;
+    size_t next_size;
+    struct list_head pool;
+    char *pool_cursor;
+    size_t pool_avail;
+    size_t pool_next;
+    size_t pool_live;
+} arena_t;
+
+/**
+ * arena_init() - Initialize an empty arena, no memory is allocated
+ * @a: arena to be initialized
+ */
+void arena_init(arena_t *a);
+
+/**
+ * arena_alloc() - Allocate an object from the arena
+ * @a: arena to allocate from
+ * @size: size of the object in bytes
+ * @chunk: set to the chunk the object was carved from
+ *
+ * The returned object must be released with arena_free() using the same
+ * @size and the chunk returned here.
+ *
+ * Return: pointer to the object, NULL if allocation failed
+ */
+void *arena_alloc(arena_t *a, size_t size, arena_chunk_t **chunk);
+
+/**
+ * arena_alloc_block() - Allocate a contiguous block to carve objects from
+ * @a: arena to allocate from
+ * @size: size of the block in bytes
+ * @chunk: set to the chunk the block was carved from
+ *
+ * The caller lays out objects of at most ARENA_MAX_OBJECT bytes in the block
+ * itself, each starting at a multiple of ARENA_ALIGN and spanning
+ * arena_round_up() of its size. They are released one by one with
+ * arena_free() and the chunk returned here, as if they came from
+ * arena_alloc(). The block bypasses the free lists, so it is never
+ * fragmented.
+ *
+ * Return: pointer to the block, NULL if allocation failed
+ */
+void *arena_alloc_block(arena_t *a, size_t size, arena_chunk_t **chunk);
+
+/**
+ * arena_free() - Return an object to the arena owning @chunk
+ * @chunk: chunk the object was carved from
+ * @p: the object
+ * @size: size of the object, as passed to arena_alloc()
+ */
+void arena_free(arena_chunk_t *chunk, void *p, size_t size);
+
+/**
+ * arena_strdup() - Append a copy of a string to the string pool
+ * @a: arena to allocate from
+ * @s: the string
+ * @len: length of @s, not counting the null terminator
+ *
+ * The copy must be given up with arena_strfree().
+ *
+ * Return: the copy, NULL if allocation failed
+ */
+char *arena_strdup(arena_t *a, const char *s, size_t len);
+
+/* Give up a string of @len characters copied with arena_strdup() */
+static inline void arena_strfree(arena_t *a, size_t len)
+{
+    a->pool_live -= len + 1;
+}
+
+/**
+ * arena_pool_renew() - Start the string pool over in a single chunk
+ * @a: arena owning the pool
+ * @size: bytes the chunk has room for, at least what the strings copied
+ *        into it take
+ * @old: list receiving the chunks of the previous pool
+ *
+ * The strings of the previous pool stay valid, so that they can be copied
+ * into the new one with arena_strdup(), until arena_pool_drop() is called
+ * on @old. No chunk is allocated for a @size of zero.
+ *
+ * Return: true for success, false if allocation failed, the pool being left
+ * as it was
+ */
+bool arena_pool_renew(arena_t *a, size_t size, struct list_head *old);
+
+/* Free the string chunks given up by arena_pool_renew() */
+void arena_pool_drop(struct list_head *old);
+
+/**
+ * arena_adopt() - Move all chunks of @src into @dst
+ * @dst: arena receiving the chunks
+ * @src: arena giving up its chunks, left empty
+ *
+ * Objects already allocated from @src remain valid and are released into
+ * @dst from now on. This function never allocates memory.
+ */
+void arena_adopt(arena_t *dst, arena_t *src);
+
+/**
+ * arena_destroy() - Release every chunk owned by the arena at once
+ * @a: arena to be destroyed
+ *
+ * All objects allocated from the arena become invalid, including the ones
+ * which were handed out but not yet released.
+ */
+void arena_destroy(arena_t *a);
+
+#endif /* LAB0_ARENA_H */
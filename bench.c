@@ -0,0 +1,367 @@
+/* Micro-benchmarks for queue operations
+ *
+ * Each benchmark builds its input outside of the timed region and reports
+ * the throughput of the operation under test. Run all of them with
+ * 'make bench', or pick some by name: ./qbench -n 100000 insert-free
+ *
+ * The queue backend is picked at build time, so comparing backends means
+ * running both builds: make bench QUEUE_BACKEND=unrolled
+ *
+ * The sort benchmarks run on as many threads as -t gives, for instance:
+ * ./qbench -t 4 sort sort-radix
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Our program needs to use regular malloc/free */
+#define INTERNAL 1
+#include "harness.h"
+
+#include "queue.h"
+
+#define MIN_RANDSTR_LEN 5
+#define MAX_RANDSTR_LEN 10
+static const char charset[] = "abcdefghijklmnopqrstuvwxyz";
+
+/* Random input strings, generated once and shared by every benchmark */
+static char (*strings)[MAX_RANDSTR_LEN + 1];
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void fill_strings(int n)
+{
+    strings = malloc(sizeof(*strings) * n);
+    for (int i = 0; i < n; i++) {
+        int len = MIN_RANDSTR_LEN +
+                  rand() % (MAX_RANDSTR_LEN - MIN_RANDSTR_LEN + 1);
+        for (int j = 0; j < len; j++)
+            strings[i][j] = charset[rand() % (sizeof(charset) - 1)];
+        strings[i][len] = '\0';
+    }
+}
+
+static struct list_head *build_queue(int n)
+{
+    struct list_head *q = q_new();
+    for (int i = 0; i < n; i++)
+        q_insert_tail(q, strings[i]);
+    return q;
+}
+
+/* Insert n elements at the tail, then free the whole queue */
+static double bench_insert_free(int n)
+{
+    double start = now();
+    q_free(build_queue(n));
+    return now() - start;
+}
+
+/* Insert n elements at the tail with a single bulk call, then free them */
+static double bench_insert_bulk_free(int n)
+{
+    char **strs = malloc(sizeof(char *) * n);
+    for (int i = 0; i < n; i++)
+        strs[i] = strings[i];
+    double start = now();
+    struct list_head *q = q_new();
+    q_insert_tail_bulk(q, strs, n);
+    q_free(q);
+    double t = now() - start;
+    free(strs);
+    return t;
+}
+
+/* The same workload with one malloc and one free per element, as queue.c
+ * did before elements were carved from a per-queue arena.
+ */
+static double bench_insert_free_malloc(int n)
+{
+    double start = now();
+    struct list_head *q = test_malloc(sizeof(struct list_head));
+    INIT_LIST_HEAD(q);
+    for (int i = 0; i < n; i++) {
+        size_t len = strlen(strings[i]) + 1;
+        element_t *e = test_malloc(sizeof(element_t) + len);
+        e->len = len - 1;
+        e->value = memcpy(e->buf, strings[i], len);
+        list_add_tail(&e->list, q);
+    }
+    element_t *e, *safe;
+    list_for_each_entry_safe (e, safe, q, list)
+        test_free(e);
+    test_free(q);
+    return now() - start;
+}
+
+/* Use the queue as a FIFO: insert n elements at the tail, then remove and
+ * release them from the head
+ */
+static double bench_fifo(int n)
+{
+    double start = now();
+    struct list_head *q = build_queue(n);
+    for (int i = 0; i < n; i++)
+        q_release_element(q_remove_head(q, NULL, 0));
+    q_free(q);
+    return now() - start;
+}
+
+/* Sort n random strings */
+static double bench_sort(int n)
+{
+    struct list_head *q = build_queue(n);
+    double start = now();
+    q_sort(q, false);
+    double t = now() - start;
+    q_free(q);
+    return t;
+}
+
+/* Sort n random strings with the MSD radix sort */
+static double bench_sort_radix(int n)
+{
+    sort_algo = SORT_RADIX;
+    double t = bench_sort(n);
+    sort_algo = SORT_MERGE;
+    return t;
+}
+
+/* Sort a queue which is already sorted */
+static double bench_sort_sorted(int n)
+{
+    struct list_head *q = build_queue(n);
+    q_sort(q, false);
+    double start = now();
+    q_sort(q, false);
+    double t = now() - start;
+    q_free(q);
+    return t;
+}
+
+/* Sort a queue which is sorted in the opposite order */
+static double bench_sort_reversed(int n)
+{
+    struct list_head *q = build_queue(n);
+    q_sort(q, true);
+    double start = now();
+    q_sort(q, false);
+    double t = now() - start;
+    q_free(q);
+    return t;
+}
+
+/* Keeps the compiler from dropping the traversal */
+static volatile size_t traverse_sink;
+
+/* Walk a sorted queue, whose elements are scattered over the arena, and
+ * read the length of each string
+ */
+static double bench_traverse(int n)
+{
+    struct list_head *q = build_queue(n);
+    q_sort(q, false);
+    double start = now();
+    size_t total = 0;
+    q_iter_t it;
+    for (element_t *e = q_first(q, &it); e; e = q_next(&it))
+        total += e->len;
+    traverse_sink = total;
+    double t = now() - start;
+    q_free(q);
+    return t;
+}
+
+/* Group size for the reverse-k benchmarks */
+#define BENCH_K 8
+
+/* Swap every pair of adjacent elements */
+static double bench_swap(int n)
+{
+    struct list_head *q = build_queue(n);
+    q_sort(q, false);
+    double start = now();
+    q_swap(q);
+    double t = now() - start;
+    q_free(q);
+    return t;
+}
+
+/* Reverse the queue in groups of BENCH_K elements */
+static double bench_reverse_k(int n)
+{
+    struct list_head *q = build_queue(n);
+    q_sort(q, false);
+    double start = now();
+    q_reverseK(q, BENCH_K);
+    double t = now() - start;
+    q_free(q);
+    return t;
+}
+
+/* The same workload the way q_reverseK used to do it: count the elements
+ * with a full traversal, as q_size did at the time, then cut each group into
+ * a temporary list, reverse it and splice it back.
+ */
+static double bench_reverse_k_splice(int n)
+{
+    struct list_head *q = build_queue(n);
+    q_sort(q, false);
+    double start = now();
+    struct list_head group, *pos = q;
+    INIT_LIST_HEAD(&group);
+    int len = 0;
+    list_for_each (pos, q)
+        len++;
+    for (int i = len / BENCH_K; i > 0; i--) {
+        struct list_head *tail = pos;
+        for (int j = 0; j < BENCH_K; j++)
+            tail = tail->next;
+        list_cut_position(&group, pos, tail);
+        q_reverse(&group);
+        list_splice_init(&group, pos);
+        for (int j = 0; j < BENCH_K; j++)
+            pos = pos->next;
+    }
+    double t = now() - start;
+    q_free(q);
+    return t;
+}
+
+/* Look up n random positions */
+static double bench_at(int n)
+{
+    struct list_head *q = build_queue(n);
+    q_at(q, 0);
+    double start = now();
+    for (int i = 0; i < n; i++)
+        q_at(q, rand() % n);
+    double t = now() - start;
+    q_free(q);
+    return t;
+}
+
+/* Insert and delete at n random positions */
+static double bench_insert_delete_at(int n)
+{
+    struct list_head *q = build_queue(n);
+    q_at(q, 0);
+    double start = now();
+    for (int i = 0; i < n; i++) {
+        q_insert_at(q, rand() % n, strings[i]);
+        q_delete_at(q, rand() % n);
+    }
+    double t = now() - start;
+    q_free(q);
+    return t;
+}
+
+typedef struct {
+    char *name;
+    double (*run)(int n);
+} bench_t;
+
+static const bench_t benches[] = {
+    {"insert-free", bench_insert_free},
+    {"insert-free-malloc", bench_insert_free_malloc},
+    {"insert-bulk-free", bench_insert_bulk_free},
+    {"fifo", bench_fifo},
+    {"sort", bench_sort},
+    {"sort-sorted", bench_sort_sorted},
+    {"sort-reversed", bench_sort_reversed},
+    {"sort-radix", bench_sort_radix},
+    {"traverse", bench_traverse},
+    {"swap", bench_swap},
+    {"reverse-k", bench_reverse_k},
+    {"reverse-k-splice", bench_reverse_k_splice},
+    {"at", bench_at},
+    {"insert-delete-at", bench_insert_delete_at},
+};
+
+static bool selected(const char *name, int argc, char *argv[])
+{
+    if (optind == argc)
+        return true;
+    for (int i = optind; i < argc; i++) {
+        if (!strcmp(name, argv[i]))
+            return true;
+    }
+    return false;
+}
+
+static void usage(char *cmd)
+{
+    printf("Usage: %s [-h] [-n N] [-r REPS] [-t THREADS] [benchmark...]\n",
+           cmd);
+    printf("\t-h         Print this information\n");
+    printf("\t-n N       Number of elements (default: 1000000)\n");
+    printf("\t-r REPS    Repetitions, the best one is reported (default: 3)\n");
+    printf("\t-t THREADS Threads sorting in parallel (default: 1)\n");
+    printf("Benchmarks:");
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++)
+        printf(" %s", benches[i].name);
+    printf("\n");
+    exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+    int n = 1000000, reps = 3, threads = 1;
+    int c;
+
+    while ((c = getopt(argc, argv, "hn:r:t:")) != -1) {
+        switch (c) {
+        case 'n':
+            n = atoi(optarg);
+            break;
+        case 'r':
+            reps = atoi(optarg);
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            break;
+        }
+    }
+    if (n <= 0 || reps <= 0 || threads <= 0)
+        usage(argv[0]);
+    int got = sort_set_threads(threads);
+    if (got != threads)
+        printf("Sorting with %d threads\n", got);
+
+    /* Block-by-block verification of every free is far too slow here */
+    set_cautious_mode(false);
+    srand(1);
+    fill_strings(n);
+
+    printf("%-24s %10s %12s\n", "benchmark", "time (ms)", "Mops/s");
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        if (!selected(benches[i].name, argc, argv))
+            continue;
+        double best = 0;
+        for (int r = 0; r < reps; r++) {
+            double t = benches[i].run(n);
+            if (!r || t < best)
+                best = t;
+        }
+        printf("%-24s %10.2f %12.2f\n", benches[i].name, best * 1e3,
+               n / best * 1e-6);
+        if (allocation_check())
+            printf("%-24s leaked %lu blocks\n", benches[i].name,
+                   allocation_check());
+    }
+
+    sort_set_threads(1);
+    free(strings);
+    return 0;
+}
@@ -0,0 +1,291 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The wrapper itself uses regular malloc/free, the queues it holds allocate
+ * through the backend as usual.
+ */
+#define INTERNAL 1
+#include "harness.h"
+
+#include "cqueue.h"
+
+static void lock_both(cq_t *cq)
+{
+    pthread_mutex_lock(&cq->head_lock);
+    pthread_mutex_lock(&cq->tail_lock);
+}
+
+static void unlock_both(cq_t *cq)
+{
+    pthread_mutex_unlock(&cq->tail_lock);
+    pthread_mutex_unlock(&cq->head_lock);
+}
+
+/* Move the elements of @back to the tail of @front, with both locks held.
+ * The two queues are swapped if @front is empty. Otherwise the elements are
+ * copied, since the queue interface cannot move them from a queue to
+ * another, each one leaving @back once its copy is in @front. Return false
+ * if there was no memory, with the elements still in order across the two.
+ */
+static bool join(cq_t *cq)
+{
+    if (!q_size(cq->front)) {
+        struct list_head *tmp = cq->front;
+        cq->front = cq->back;
+        cq->back = tmp;
+        return true;
+    }
+
+    q_iter_t it;
+    element_t *e;
+    while ((e = q_first(cq->back, &it))) {
+        if (!q_insert_tail(cq->front, e->value))
+            return false;
+        q_release_element(q_remove_head(cq->back, NULL, 0));
+    }
+    return true;
+}
+
+/* Take both locks and gather all the elements in @front. Return the queue,
+ * or NULL with no lock held if there was no memory to join the two halves.
+ */
+static struct list_head *lock_all(cq_t *cq)
+{
+    if (!cq)
+        return NULL;
+    lock_both(cq);
+    if (q_size(cq->back) && !join(cq)) {
+        unlock_both(cq);
+        return NULL;
+    }
+    return cq->front;
+}
+
+cq_t *cq_new()
+{
+    cq_t *cq = aligned_alloc(CQ_CACHE_LINE, sizeof(cq_t));
+    if (!cq)
+        return NULL;
+    /* Queues allocate under their own tail lock only, so the bookkeeping
+     * of the allocation checker needs its own lock.
+     */
+    set_shared_heap();
+    cq->front = q_new();
+    cq->back = q_new();
+    if (!cq->front || !cq->back) {
+        q_free(cq->front);
+        q_free(cq->back);
+        free(cq);
+        return NULL;
+    }
+    pthread_mutex_init(&cq->head_lock, NULL);
+    pthread_mutex_init(&cq->tail_lock, NULL);
+    return cq;
+}
+
+void cq_free(cq_t *cq)
+{
+    if (!cq)
+        return;
+    q_free(cq->front);
+    q_free(cq->back);
+    pthread_mutex_destroy(&cq->head_lock);
+    pthread_mutex_destroy(&cq->tail_lock);
+    free(cq);
+}
+
+bool cq_insert_tail(cq_t *cq, char *s)
+{
+    if (!cq)
+        return false;
+    pthread_mutex_lock(&cq->tail_lock);
+    bool ok = q_insert_tail(cq->back, s);
+    pthread_mutex_unlock(&cq->tail_lock);
+    return ok;
+}
+
+element_t *cq_remove_head(cq_t *cq, char *sp, size_t bufsize)
+{
+    if (!cq)
+        return NULL;
+    pthread_mutex_lock(&cq->head_lock);
+    if (!q_size(cq->front)) {
+        /* Take over everything inserted so far in one go */
+        pthread_mutex_lock(&cq->tail_lock);
+        struct list_head *tmp = cq->front;
+        cq->front = cq->back;
+        cq->back = tmp;
+        pthread_mutex_unlock(&cq->tail_lock);
+    }
+    element_t *e = q_remove_head(cq->front, sp, bufsize);
+    pthread_mutex_unlock(&cq->head_lock);
+    return e;
+}
+
+void cq_release_element(cq_t *cq, element_t *e)
+{
+    if (!cq || !e)
+        return;
+    pthread_mutex_lock(&cq->tail_lock);
+    q_release_element(e);
+    pthread_mutex_unlock(&cq->tail_lock);
+}
+
+bool cq_insert_head(cq_t *cq, char *s)
+{
+    if (!cq)
+        return false;
+    lock_both(cq);
+    bool ok = q_insert_head(cq->front, s);
+    unlock_both(cq);
+    return ok;
+}
+
+element_t *cq_remove_tail(cq_t *cq, char *sp, size_t bufsize)
+{
+    if (!cq)
+        return NULL;
+    lock_both(cq);
+    element_t *e = q_remove_tail(q_size(cq->back) ? cq->back : cq->front, sp,
+                                 bufsize);
+    unlock_both(cq);
+    return e;
+}
+
+int cq_size(cq_t *cq)
+{
+    if (!cq)
+        return 0;
+    lock_both(cq);
+    int n = q_size(cq->front) + q_size(cq->back);
+    unlock_both(cq);
+    return n;
+}
+
+bool cq_delete_mid(cq_t *cq)
+{
+    struct list_head *q = lock_all(cq);
+    if (!q)
+        return false;
+    bool ok = q_delete_mid(q);
+    unlock_both(cq);
+    return ok;
+}
+
+bool cq_delete_dup(cq_t *cq)
+{
+    struct list_head *q = lock_all(cq);
+    if (!q)
+        return false;
+    bool ok = q_delete_dup(q);
+    unlock_both(cq);
+    return ok;
+}
+
+void cq_swap(cq_t *cq)
+{
+    struct list_head *q = lock_all(cq);
+    if (!q)
+        return;
+    q_swap(q);
+    unlock_both(cq);
+}
+
+void cq_reverse(cq_t *cq)
+{
+    struct list_head *q = lock_all(cq);
+    if (!q)
+        return;
+    q_reverse(q);
+    unlock_both(cq);
+}
+
+void cq_reverseK(cq_t *cq, int k)
+{
+    struct list_head *q = lock_all(cq);
+    if (!q)
+        return;
+    q_reverseK(q, k);
+    unlock_both(cq);
+}
+
+void cq_sort(cq_t *cq, bool descend)
+{
+    struct list_head *q = lock_all(cq);
+    if (!q)
+        return;
+    q_sort(q, descend);
+    unlock_both(cq);
+}
+
+int cq_ascend(cq_t *cq)
+{
+    struct list_head *q = lock_all(cq);
+    if (!q)
+        return cq_size(cq);
+    int n = q_ascend(q);
+    unlock_both(cq);
+    return n;
+}
+
+int cq_descend(cq_t *cq)
+{
+    struct list_head *q = lock_all(cq);
+    if (!q)
+        return cq_size(cq);
+    int n = q_descend(q);
+    unlock_both(cq);
+    return n;
+}
+
+static int cq_addr_cmp(const void *a, const void *b)
+{
+    uintptr_t x = (uintptr_t) *(cq_t *const *) a;
+    uintptr_t y = (uintptr_t) *(cq_t *const *) b;
+    return (x > y) - (x < y);
+}
+
+int cq_merge(cq_t *cqs[], int n, bool descend)
+{
+    if (!cqs || n <= 0 || !cqs[0])
+        return 0;
+
+    cq_t **order = malloc(sizeof(cq_t *) * n);
+    queue_contex_t *ctx = malloc(sizeof(queue_contex_t) * n);
+    if (!order || !ctx) {
+        free(order);
+        free(ctx);
+        return cq_size(cqs[0]);
+    }
+    memcpy(order, cqs, sizeof(cq_t *) * n);
+    qsort(order, n, sizeof(cq_t *), cq_addr_cmp);
+
+    int locked = 0, total = 0;
+    while (locked < n && lock_all(order[locked]))
+        locked++;
+
+    bool all = locked == n;
+    int len = 0;
+    if (all) {
+        LIST_HEAD(chain);
+        for (int i = 0; i < n; i++) {
+            ctx[i].q = cqs[i]->front;
+            ctx[i].size = q_size(cqs[i]->front);
+            ctx[i].id = i;
+            list_add_tail(&ctx[i].chain, &chain);
+            total += ctx[i].size;
+        }
+        /* q_merge() may not allocate, make room for the merged queue first */
+        if (q_reserve(cqs[0]->front, total))
+            len = q_merge(&chain, descend);
+        else
+            len = q_size(cqs[0]->front);
+    }
+
+    while (locked--)
+        unlock_both(order[locked]);
+    free(order);
+    free(ctx);
+    return all ? len : cq_size(cqs[0]);
+}
@@ -0,0 +1,128 @@
+#ifndef LAB0_CQUEUE_H
+#define LAB0_CQUEUE_H
+
+/* Thread-safe wrapper around the queue.h interface.
+ *
+ * Follows the two-lock queue algorithm: insertions at the tail and removals
+ * from the head take separate locks, so producers and consumers proceed in
+ * parallel. The queue backends keep state that both ends touch, such as the
+ * element count and the arena, so rather than a single list with a dummy
+ * node the wrapper holds two backend queues:
+ *
+ *   - @back receives q_insert_tail(), under the tail lock;
+ *   - @front serves q_remove_head(), under the head lock.
+ *
+ * When @front runs dry, the remover briefly takes the tail lock as well and
+ * swaps the two queues, taking over every element inserted so far at once.
+ * Every other operation takes both locks, head lock first, and joins @back
+ * to @front before working on the whole queue.
+ *
+ * Memory is allocated and released under the tail lock only: q_remove_head()
+ * does neither, so it never contends with allocation. Elements removed from
+ * a queue must be given back with cq_release_element() on that same queue,
+ * before the queue is merged into another one. The allocation checker of
+ * harness.c, shared by all queues, is switched to shared mode by cq_new(), so
+ * distinct queues may allocate concurrently. The intern table is not
+ * thread-safe, so intern mode must be off.
+ *
+ * Positional access and iterators are not offered, since what they return
+ * would only be valid while the locks are held.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "queue.h"
+
+/* Keeps the two locks on separate cache lines */
+#define CQ_CACHE_LINE 64
+
+/**
+ * cq_t - Queue shared between threads
+ * @head_lock: guards @front
+ * @front: the elements at the head of the queue
+ * @tail_lock: guards @back and every allocation
+ * @back: the elements at the tail of the queue, after those of @front
+ */
+typedef struct {
+    _Alignas(CQ_CACHE_LINE) pthread_mutex_t head_lock;
+    struct list_head *front;
+    _Alignas(CQ_CACHE_LINE) pthread_mutex_t tail_lock;
+    struct list_head *back;
+} cq_t;
+
+/**
+ * cq_new() - Create an empty queue
+ *
+ * Switches the allocation checker to shared mode, see set_shared_heap(), so
+ * the first queue has to be created before the threads using it start.
+ *
+ * Return: NULL for allocation failed
+ */
+cq_t *cq_new();
+
+/**
+ * cq_free() - Free all storage used by queue
+ * @cq: queue to be deleted, which no other thread may be operating on
+ */
+void cq_free(cq_t *cq);
+
+/**
+ * cq_insert_tail() - Insert an element at the tail, taking the tail lock
+ * @cq: queue
+ * @s: string to be copied and inserted into the queue
+ *
+ * Return: true for success, false for allocation failed or queue is NULL
+ */
+bool cq_insert_tail(cq_t *cq, char *s);
+
+/**
+ * cq_remove_head() - Remove the element from the head, taking the head lock
+ * @cq: queue
+ * @sp: string would be inserted
+ * @bufsize: size of the string
+ *
+ * Same semantics as q_remove_head(). The tail lock is also taken when all
+ * the elements at hand have been removed.
+ *
+ * Return: the removed element, NULL if the queue was empty or NULL
+ */
+element_t *cq_remove_head(cq_t *cq, char *sp, size_t bufsize);
+
+/**
+ * cq_release_element() - Release an element removed from queue
+ * @cq: the queue @e was removed from
+ * @e: element to be released, may be NULL
+ */
+void cq_release_element(cq_t *cq, element_t *e);
+
+/* The operations below take both locks, see their queue.h counterparts */
+
+bool cq_insert_head(cq_t *cq, char *s);
+element_t *cq_remove_tail(cq_t *cq, char *sp, size_t bufsize);
+int cq_size(cq_t *cq);
+bool cq_delete_mid(cq_t *cq);
+bool cq_delete_dup(cq_t *cq);
+void cq_swap(cq_t *cq);
+void cq_reverse(cq_t *cq);
+void cq_reverseK(cq_t *cq, int k);
+void cq_sort(cq_t *cq, bool descend);
+int cq_ascend(cq_t *cq);
+int cq_descend(cq_t *cq);
+
+/**
+ * cq_merge() - Merge sorted queues into the first one
+ * @cqs: the queues, all distinct
+ * @n: number of queues
+ * @descend: whether the queues are sorted in descending order
+ *
+ * Takes the locks of all the queues, in address order so that concurrent
+ * merges of overlapping sets of queues cannot deadlock. The other queues
+ * are left empty, as with q_merge().
+ *
+ * Return: the number of elements in the first queue after merging
+ */
+int cq_merge(cq_t *cqs[], int n, bool descend);
+
+#endif /* LAB0_CQUEUE_H */
@@ -0,0 +1,147 @@
+#include <stdlib.h>
+
+#include "element.h"
+
+int intern_mode = 0;
+int pool_mode = 0;
+
+bool element_init(element_t *e,
+                  arena_chunk_t *chunk,
+                  const char *s,
+                  size_t len)
+{
+    if (len > UINT32_MAX)
+        return false;
+
+    e->pooled = !intern_mode && pool_mode;
+    if (intern_mode) {
+        e->value = (char *) intern_get(s, len);
+    } else if (pool_mode) {
+        e->value = arena_strdup(chunk->arena, s, len);
+    } else {
+        e->value = memcpy(e->buf, s, len + 1);
+    }
+    if (!e->value)
+        return false;
+    e->chunk = chunk;
+    e->len = len;
+    e->key = key_of(s);
+    return true;
+}
+
+element_t *element_new(arena_t *a, const char *s)
+{
+    size_t len = strlen(s);
+    size_t size = element_size(len);
+    arena_chunk_t *chunk;
+    element_t *e = arena_alloc(a, size, &chunk);
+    if (!e)
+        return NULL;
+
+    if (!element_init(e, chunk, s, len)) {
+        arena_free(chunk, e, size);
+        return NULL;
+    }
+    return e;
+}
+
+bool pool_compact(arena_t *a, struct list_head *head)
+{
+    LIST_HEAD(old);
+    if (!arena_pool_renew(a, a->pool_live, &old))
+        return false;
+
+    /* The new chunk has room for exactly the live strings, copying them
+     * cannot fail
+     */
+    q_iter_t it;
+    for (element_t *e = q_first(head, &it); e; e = q_next(&it)) {
+        if (e->pooled)
+            e->value = arena_strdup(a, e->value, e->len);
+    }
+    arena_pool_drop(&old);
+    return true;
+}
+
+void pack_strings(struct list_head *list, char *sp, size_t bufsize)
+{
+    if (!sp || !bufsize)
+        return;
+
+    element_t *e;
+    list_for_each_entry (e, list, list) {
+        size_t len = e->len + 1;
+        if (len >= bufsize)
+            break;
+        memcpy(sp, e->value, len);
+        sp += len;
+        bufsize -= len;
+    }
+    *sp = '\0';
+}
+
+/* Smallest number of slots of a dup_table_t */
+#define DUP_MIN_SLOTS 16
+
+/* Hash the string of @e, starting from its cached prefix */
+static uint64_t element_hash(const element_t *e)
+{
+    uint64_t h = e->key * 0x9e3779b97f4a7c15ULL;
+    for (size_t i = 8; i < e->len; i++) {
+        h ^= (unsigned char) e->value[i];
+        h *= 1099511628211ULL;
+    }
+    return h ^ (h >> 29);
+}
+
+/* The slot holding the string of @e, whose hash is @h, or the empty slot
+ * where it would go
+ */
+static dup_slot_t *dup_find(const dup_table_t *t,
+                            const element_t *e,
+                            uint64_t h)
+{
+    uint32_t tag = h >> 32;
+    for (size_t i = h & t->mask;; i = (i + 1) & t->mask) {
+        dup_slot_t *s = &t->slots[i];
+        if (!s->e || (s->tag == tag && element_eq(s->e, e)))
+            return s;
+    }
+}
+
+bool dup_table_build(dup_table_t *t, struct list_head *head)
+{
+    size_t n = DUP_MIN_SLOTS;
+    while (n < 2 * (size_t) q_size(head))
+        n <<= 1;
+    t->slots = malloc(n * sizeof(dup_slot_t));
+    if (!t->slots)
+        return false;
+    memset(t->slots, 0, n * sizeof(dup_slot_t));
+    t->mask = n - 1;
+
+    q_iter_t it;
+    for (element_t *e = q_first(head, &it); e; e = q_next(&it)) {
+        uint64_t h = element_hash(e);
+        dup_slot_t *s = dup_find(t, e, h);
+        if (s->e) {
+            s->count = 2;
+        } else {
+            s->e = e;
+            s->tag = h >> 32;
+            s->count = 1;
+        }
+    }
+    return true;
+}
+
+bool dup_table_repeated(const dup_table_t *t, const element_t *e)
+{
+    return dup_find(t, e, element_hash(e))->count > 1;
+}
+
+void dup_table_free(dup_table_t *t)
+{
+    free(t->slots);
+    t->slots = NULL;
+}
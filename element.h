@@ -0,0 +1,175 @@
+#ifndef LAB0_ELEMENT_H
+#define LAB0_ELEMENT_H
+
+/* Helpers on queue elements shared by the queue backends.
+ *
+ * Not part of the queue interface: they are only meant for the files
+ * implementing it.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "queue.h"
+
+/* Pack the first 8 bytes of @s, zero padded, into a big-endian word */
+static inline uint64_t key_of(const char *s)
+{
+    uint64_t key = 0;
+    for (int i = 0; i < 8; i++) {
+        key <<= 8;
+        if (*s)
+            key |= (unsigned char) *s++;
+    }
+    return key;
+}
+
+/* Compare two elements, the sign follows strcmp() on their strings. The
+ * strings are only consulted when the cached prefixes are equal, and not at
+ * all when both elements share an interned string.
+ */
+static inline int element_cmp(const element_t *a, const element_t *b)
+{
+    if (a->key != b->key)
+        return a->key < b->key ? -1 : 1;
+
+    /* The last byte of the prefix is zero iff both strings ended within it */
+    if (!(a->key & 0xff) || a->value == b->value)
+        return 0;
+    return strcmp(a->value + 8, b->value + 8);
+}
+
+/* Size of a new element holding a string of @len characters */
+static inline size_t element_size(size_t len)
+{
+    return intern_mode || pool_mode ? sizeof(element_t)
+                                    : sizeof(element_t) + len + 1;
+}
+
+/* Whether @e holds a reference to an interned string */
+static inline bool element_interned(const element_t *e)
+{
+    return !e->pooled && e->value != e->buf;
+}
+
+/**
+ * element_init() - Fill in an element with a copy of a string
+ * @e: the element, element_size(@len) bytes carved from @chunk
+ * @chunk: arena chunk @e was carved from
+ * @s: the string
+ * @len: length of @s
+ *
+ * The string is copied into the element, referenced through the intern
+ * table in intern mode, or copied into the string pool of the arena owning
+ * @chunk in pool mode.
+ *
+ * Return: true for success, false if the string is too long or could not be
+ * interned or pooled
+ */
+bool element_init(element_t *e,
+                  arena_chunk_t *chunk,
+                  const char *s,
+                  size_t len);
+
+/**
+ * element_new() - Allocate an element for a copy of a string
+ * @a: arena to allocate from
+ * @s: the string
+ *
+ * Return: the element, NULL for allocation failed
+ */
+element_t *element_new(arena_t *a, const char *s);
+
+/* Copy the string of @e into @sp, truncated to @bufsize - 1 characters */
+static inline void copy_value(char *sp, size_t bufsize, const element_t *e)
+{
+    if (!bufsize)
+        return;
+
+    size_t len = e->len < bufsize - 1 ? e->len : bufsize - 1;
+    memcpy(sp, e->value, len);
+    sp[len] = '\0';
+}
+
+/**
+ * pack_strings() - Copy the strings of a list of elements into a buffer
+ * @list: the elements, linked through their @list member
+ * @sp: the buffer, may be NULL
+ * @bufsize: size of @sp
+ *
+ * The strings are packed back to back, each followed by a null terminator,
+ * and the whole list ends with an empty string. A string which does not fit
+ * is left out along with all the strings after it.
+ */
+void pack_strings(struct list_head *list, char *sp, size_t bufsize);
+
+/**
+ * pool_compact() - Move the pooled strings of a queue into a single block
+ * @a: arena of the queue
+ * @head: header of queue, walked with q_first() and q_next()
+ *
+ * See q_compact().
+ *
+ * Return: true for success, false if allocation failed
+ */
+bool pool_compact(arena_t *a, struct list_head *head);
+
+/* Whether @a and @b hold the same string */
+static inline bool element_eq(const element_t *a, const element_t *b)
+{
+    /* The prefix covers strings of up to 8 characters entirely */
+    return a->len == b->len && a->key == b->key &&
+           (a->len <= 8 || a->value == b->value ||
+            !memcmp(a->value + 8, b->value + 8, a->len - 8));
+}
+
+/**
+ * dup_slot_t - Slot of a dup_table_t
+ * @e: first element seen holding the string, NULL for an empty slot
+ * @tag: upper half of the hash of the string
+ * @count: number of elements holding the string, saturating at 2
+ */
+typedef struct {
+    const element_t *e;
+    uint32_t tag;
+    uint32_t count;
+} dup_slot_t;
+
+/**
+ * dup_table_t - Open-addressing table counting the strings of a queue
+ * @slots: the slots, at most half of them used, probed linearly
+ * @mask: number of slots minus one
+ *
+ * The table refers to the elements of the queue, which must all stay in
+ * place until it is freed: elements found to be repeated are only released
+ * once the table is gone.
+ */
+typedef struct {
+    dup_slot_t *slots;
+    size_t mask;
+} dup_table_t;
+
+/**
+ * dup_table_build() - Count the strings of every element of a queue
+ * @t: the table to fill in
+ * @head: header of queue, walked with q_first() and q_next()
+ *
+ * Return: true for success, false if no memory for the table
+ */
+bool dup_table_build(dup_table_t *t, struct list_head *head);
+
+/**
+ * dup_table_repeated() - Whether the string of an element is held by others
+ * @t: the table, built from the queue of @e
+ * @e: the element
+ *
+ * Return: true if more than one element of the queue holds the string
+ */
+bool dup_table_repeated(const dup_table_t *t, const element_t *e);
+
+/* Free the slots of @t */
+void dup_table_free(dup_table_t *t);
+
+#endif /* LAB0_ELEMENT_H */
@@ -1,5 +1,6 @@
 /* Test support code */
 
+#include <pthread.h>
 #include <setjmp.h>
 #include <signal.h>
 #include <stdio.h>
@@ -53,6 +54,17 @@ static char *error_message = "";
 
 static int time_limit = 1;
 
+/* Set once another thread may free blocks, see set_shared_heap() */
+static bool shared_heap = false;
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Frees on a background thread, see set_background_free() */
+static __thread bool background = false;
+static __thread bool background_cautious = false;
+
+static void (*allocation_waiter)() = NULL;
+static void (*exception_unwinder)() = NULL;
+
 /* Data for managing exceptions */
 static jmp_buf env;
 static volatile sig_atomic_t jmp_ready = false;
@@ -67,6 +79,31 @@ static bool fail_allocation()
     return (weight < 0.01 * fail_probability);
 }
 
+/* Take the heap lock if other threads may free blocks. The timer of
+ * exception_setup() is held off meanwhile, since unwinding the stack with
+ * the lock taken would leave it taken for good.
+ */
+static inline bool lock_heap(sigset_t *saved)
+{
+    if (!shared_heap)
+        return false;
+
+    sigset_t alarm;
+    sigemptyset(&alarm);
+    sigaddset(&alarm, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &alarm, saved);
+    pthread_mutex_lock(&heap_lock);
+    return true;
+}
+
+static inline void unlock_heap(bool locked, const sigset_t *saved)
+{
+    if (!locked)
+        return;
+    pthread_mutex_unlock(&heap_lock);
+    pthread_sigmask(SIG_SETMASK, saved, NULL);
+}
+
 /* Find header of block, given its payload.
  * Signal error if doesn't seem like legitimate block
  */
@@ -79,7 +116,7 @@ static block_element_t *find_header(void *p)
 
     block_element_t *b =
         (block_element_t *) ((size_t) p - sizeof(block_element_t));
-    if (cautious_mode) {
+    if (background ? background_cautious : cautious_mode) {
         /* Make sure this is really an allocated block */
         block_element_t *ab = allocated;
         bool found = false;
@@ -143,6 +180,8 @@ void *test_malloc(size_t size)
     *find_footer(new_block) = MAGICFOOTER;
     void *p = (void *) &new_block->payload;
     memset(p, FILLCHAR, size);
+    sigset_t saved;
+    bool locked = lock_heap(&saved);
     // cppcheck-suppress nullPointerRedundantCheck
     new_block->next = allocated;
     // cppcheck-suppress nullPointerRedundantCheck
@@ -152,6 +191,7 @@ void *test_malloc(size_t size)
         allocated->prev = new_block;
     allocated = new_block;
     allocated_count++;
+    unlock_heap(locked, &saved);
 
     return p;
 }
@@ -170,7 +210,7 @@ void *test_calloc(size_t nelem, size_t elsize)
 
 void test_free(void *p)
 {
-    if (noallocate_mode) {
+    if (noallocate_mode && !background) {
         report_event(MSG_FATAL, "Calls to free disallowed");
         return;
     }
@@ -178,6 +218,8 @@ void test_free(void *p)
     if (!p)
         return;
 
+    sigset_t saved;
+    bool locked = lock_heap(&saved);
     block_element_t *b = find_header(p);
     size_t footer = *find_footer(b);
     if (footer != MAGICFOOTER) {
@@ -200,9 +242,10 @@ void test_free(void *p)
         allocated = bn;
     if (bn)
         bn->prev = bp;
+    allocated_count--;
+    unlock_heap(locked, &saved);
 
     free(b);
-    allocated_count--;
 }
 
 // cppcheck-suppress unusedFunction
@@ -218,7 +261,13 @@ char *test_strdup(const char *s)
 
 size_t allocation_check()
 {
-    return allocated_count;
+    if (allocation_waiter)
+        allocation_waiter();
+    sigset_t saved;
+    bool locked = lock_heap(&saved);
+    size_t count = allocated_count;
+    unlock_heap(locked, &saved);
+    return count;
 }
 
 /* Implementation of functions for testing */
@@ -239,6 +288,33 @@ void set_noallocate_mode(bool noallocate)
     noallocate_mode = noallocate;
 }
 
+/* From now on, serialize the bookkeeping of test_malloc() and test_free() so
+ * that other threads may free blocks concurrently.
+ */
+void set_shared_heap()
+{
+    shared_heap = true;
+}
+
+/* Mark the calling thread as releasing blocks on behalf of another one */
+void set_background_free(bool cautious)
+{
+    background = true;
+    background_cautious = cautious;
+}
+
+/* Register what allocation_check() waits for before counting blocks */
+void set_allocation_waiter(void (*wait)())
+{
+    allocation_waiter = wait;
+}
+
+/* Register what exception_setup() calls on its error return */
+void set_exception_unwinder(void (*unwind)())
+{
+    exception_unwinder = unwind;
+}
+
 /* Return whether any errors have occurred since last time set error limit */
 bool error_check()
 {
@@ -259,6 +335,8 @@ bool exception_setup(bool limit_time)
             alarm(0);
             time_limited = false;
         }
+        if (exception_unwinder)
+            exception_unwinder();
 
         if (error_message)
             report_event(MSG_ERROR, error_message);
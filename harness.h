@@ -36,6 +36,33 @@ void set_cautious_mode(bool cautious);
  */
 void set_noallocate_mode(bool noallocate);
 
+/*
+ * Let other threads free blocks while this one runs: from now on, the
+ * bookkeeping of allocated blocks is guarded by a lock. Call it before
+ * starting such a thread.
+ */
+void set_shared_heap();
+
+/*
+ * Mark the calling thread as freeing blocks in the background on behalf of
+ * the main one. Its frees are allowed in restricted allocation mode, and
+ * only checked cautiously if @cautious.
+ */
+void set_background_free(bool cautious);
+
+/*
+ * Register a function that allocation_check() calls first, to wait for
+ * blocks still being freed in the background.
+ */
+void set_allocation_waiter(void (*wait)());
+
+/*
+ * Register a function that exception_setup() calls on its error return, to
+ * clean up after the code whose stack was unwound, such as threads still
+ * working on its behalf.
+ */
+void set_exception_unwinder(void (*unwind)());
+
 /* Return whether any errors have occurred since last time checked */
 bool error_check();
 
@@ -0,0 +1,146 @@
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "harness.h"
+#include "intern.h"
+
+/* Number of buckets the table starts with, a power of two */
+#define INTERN_MIN_BUCKETS 64
+
+/**
+ * intern_t - An interned string
+ * @next: next entry in the same bucket
+ * @chunk: arena chunk the entry was carved from
+ * @hash: hash of @str
+ * @len: length of @str, not counting the null terminator
+ * @refs: number of references handed out
+ * @str: the string
+ */
+typedef struct __intern {
+    struct __intern *next;
+    arena_chunk_t *chunk;
+    uint64_t hash;
+    size_t len;
+    size_t refs;
+    char str[];
+} intern_t;
+
+/* Only the thread interning strings touches the table, but others may read
+ * @count through intern_count(), the reclaimer thread of reclaim.c when it
+ * frees a queue.
+ */
+static struct {
+    intern_t **buckets;
+    size_t mask;
+    atomic_size_t count;
+    arena_t arena;
+} table;
+
+/* FNV-1a, which does well on the short strings queues usually hold */
+static uint64_t hash_of(const char *s, size_t len)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char) s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/* Double the number of buckets once the table is as full as it is wide */
+static bool grow(void)
+{
+    size_t n = table.buckets ? (table.mask + 1) * 2 : INTERN_MIN_BUCKETS;
+    intern_t **buckets = malloc(n * sizeof(intern_t *));
+    if (!buckets)
+        return false;
+    memset(buckets, 0, n * sizeof(intern_t *));
+
+    if (!table.buckets)
+        arena_init(&table.arena);
+    for (size_t i = 0; table.buckets && i <= table.mask; i++) {
+        intern_t *e = table.buckets[i];
+        while (e) {
+            intern_t *next = e->next;
+            e->next = buckets[e->hash & (n - 1)];
+            buckets[e->hash & (n - 1)] = e;
+            e = next;
+        }
+    }
+    free(table.buckets);
+    table.buckets = buckets;
+    table.mask = n - 1;
+    return true;
+}
+
+/* Release the memory of the table once it holds no string */
+static void release_if_empty(void)
+{
+    if (table.count)
+        return;
+    arena_destroy(&table.arena);
+    free(table.buckets);
+    table.buckets = NULL;
+    table.mask = 0;
+}
+
+const char *intern_get(const char *s, size_t len)
+{
+    uint64_t hash = hash_of(s, len);
+    if (table.buckets) {
+        intern_t *e = table.buckets[hash & table.mask];
+        for (; e; e = e->next) {
+            if (e->hash == hash && e->len == len && !memcmp(e->str, s, len)) {
+                e->refs++;
+                return e->str;
+            }
+        }
+    }
+
+    if ((!table.buckets || table.count > table.mask) && !grow())
+        return NULL;
+
+    arena_chunk_t *chunk;
+    intern_t *e = arena_alloc(&table.arena, sizeof(intern_t) + len + 1, &chunk);
+    if (!e) {
+        /* Do not keep the buckets just created for a first string */
+        release_if_empty();
+        return NULL;
+    }
+
+    e->chunk = chunk;
+    e->hash = hash;
+    e->len = len;
+    e->refs = 1;
+    memcpy(e->str, s, len);
+    e->str[len] = '\0';
+    e->next = table.buckets[hash & table.mask];
+    table.buckets[hash & table.mask] = e;
+    table.count++;
+    return e->str;
+}
+
+void intern_put(const char *s)
+{
+    intern_t *e = (intern_t *) (s - offsetof(intern_t, str));
+    if (--e->refs)
+        return;
+
+    intern_t **p = &table.buckets[e->hash & table.mask];
+    while (*p != e)
+        p = &(*p)->next;
+    *p = e->next;
+    arena_free(e->chunk, e, sizeof(intern_t) + e->len + 1);
+
+    table.count--;
+    release_if_empty();
+}
+
+size_t intern_count(void)
+{
+    return atomic_load(&table.count);
+}
@@ -0,0 +1,42 @@
+#ifndef LAB0_INTERN_H
+#define LAB0_INTERN_H
+
+/* Table of interned strings shared by all queues.
+ *
+ * Each distinct string is stored once, together with a count of the
+ * references handed out for it. The copy is released when the last
+ * reference is dropped, and the table itself goes away with its last
+ * string, so an empty table holds no memory.
+ */
+
+#include <stddef.h>
+
+/**
+ * intern_get() - Take a reference to the interned copy of a string
+ * @s: the string
+ * @len: length of @s, not counting the null terminator
+ *
+ * The copy is created on first use. It must not be modified, and every
+ * reference must be dropped with intern_put().
+ *
+ * Return: the shared copy of @s, NULL if allocation failed
+ */
+const char *intern_get(const char *s, size_t len);
+
+/**
+ * intern_put() - Drop a reference taken with intern_get()
+ * @s: the shared copy, as returned by intern_get()
+ */
+void intern_put(const char *s);
+
+/**
+ * intern_count() - Get the number of distinct strings currently interned
+ *
+ * Unlike the rest of the table, which belongs to the thread interning
+ * strings, the count may be read from any thread.
+ *
+ * Return: the number of strings in the table
+ */
+size_t intern_count(void);
+
+#endif /* LAB0_INTERN_H */
@@ -0,0 +1,322 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Elements and nodes are shared between threads, and the allocation checker
+ * of harness.c is not thread-safe: use regular malloc/free.
+ */
+#define INTERNAL 1
+#include "harness.h"
+
+#include "element.h"
+#include "lfqueue.h"
+
+/* Every operation dereferences at most two nodes it does not own */
+#define HP_SLOTS 2
+
+/* Unlinked nodes a thread accumulates before it looks for free ones, on top
+ * of the number of hazard pointers in use
+ */
+#define HP_SCAN_MIN 64
+
+struct __lfq_node {
+    _Atomic(lfq_node_t *) next;
+    element_t *e;
+};
+
+/**
+ * hp_rec_t - Hazard pointers and unlinked nodes of one thread
+ * @hp: nodes the owning thread is about to dereference
+ * @active: whether a thread owns this record
+ * @next: next record, records are never removed from the list
+ * @retired: nodes unlinked by the owning thread, not freed yet
+ * @nretired: number of nodes in @retired
+ * @capacity: number of slots in @retired
+ */
+typedef struct __hp_rec {
+    _Atomic(lfq_node_t *) hp[HP_SLOTS];
+    atomic_bool active;
+    struct __hp_rec *next;
+    lfq_node_t **retired;
+    size_t nretired, capacity;
+} hp_rec_t;
+
+static _Atomic(hp_rec_t *) hp_records;
+static atomic_size_t hp_nrecords;
+
+static __thread hp_rec_t *hp_self;
+static pthread_key_t hp_key;
+static pthread_once_t hp_once = PTHREAD_ONCE_INIT;
+
+static int ptr_cmp(const void *a, const void *b)
+{
+    uintptr_t x = (uintptr_t) *(void *const *) a;
+    uintptr_t y = (uintptr_t) *(void *const *) b;
+    return (x > y) - (x < y);
+}
+
+/* Free the nodes unlinked by @self which no hazard pointer refers to */
+static void hp_scan(hp_rec_t *self)
+{
+    /* A node can only be protected by a record that existed when the node
+     * was unlinked, and records are only ever pushed at the front, so the
+     * records behind this one are all that matters.
+     */
+    hp_rec_t *first = atomic_load(&hp_records);
+    size_t n = 0;
+    for (hp_rec_t *r = first; r; r = r->next)
+        n += HP_SLOTS;
+
+    lfq_node_t **hazards = malloc(sizeof(*hazards) * n);
+    if (!hazards)
+        return;
+    n = 0;
+    for (hp_rec_t *r = first; r; r = r->next) {
+        for (int i = 0; i < HP_SLOTS; i++) {
+            lfq_node_t *p = atomic_load(&r->hp[i]);
+            if (p)
+                hazards[n++] = p;
+        }
+    }
+    qsort(hazards, n, sizeof(*hazards), ptr_cmp);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < self->nretired; i++) {
+        lfq_node_t *node = self->retired[i];
+        if (n && bsearch(&node, hazards, n, sizeof(*hazards), ptr_cmp))
+            self->retired[kept++] = node;
+        else
+            free(node);
+    }
+    self->nretired = kept;
+    free(hazards);
+}
+
+/* Defer freeing @node, unlinked by the calling thread, until it is safe */
+static void hp_retire(hp_rec_t *self, lfq_node_t *node)
+{
+    while (self->nretired == self->capacity) {
+        size_t capacity = self->capacity ? self->capacity * 2 : HP_SCAN_MIN;
+        lfq_node_t **retired =
+            realloc(self->retired, sizeof(*retired) * capacity);
+        if (retired) {
+            self->retired = retired;
+            self->capacity = capacity;
+            break;
+        }
+        /* Out of memory: wait for other threads to drop their hazards */
+        hp_scan(self);
+        sched_yield();
+    }
+    self->retired[self->nretired++] = node;
+
+    if (self->nretired >=
+        HP_SCAN_MIN + 2 * HP_SLOTS * atomic_load(&hp_nrecords))
+        hp_scan(self);
+}
+
+static void hp_release(hp_rec_t *r)
+{
+    for (int i = 0; i < HP_SLOTS; i++)
+        atomic_store(&r->hp[i], NULL);
+    hp_scan(r);
+    /* Whatever is left is inherited by the next thread taking the record */
+    atomic_store(&r->active, false);
+}
+
+static void hp_destructor(void *arg)
+{
+    hp_release(arg);
+    hp_self = NULL;
+}
+
+static void hp_key_create()
+{
+    pthread_key_create(&hp_key, hp_destructor);
+}
+
+/* Return the record of the calling thread, taking one on first use */
+static hp_rec_t *hp_acquire()
+{
+    if (hp_self)
+        return hp_self;
+
+    pthread_once(&hp_once, hp_key_create);
+    hp_rec_t *r;
+    for (r = atomic_load(&hp_records); r; r = r->next) {
+        bool idle = false;
+        if (!atomic_load(&r->active) &&
+            atomic_compare_exchange_strong(&r->active, &idle, true))
+            break;
+    }
+    if (!r) {
+        r = calloc(1, sizeof(*r));
+        if (!r)
+            return NULL;
+        atomic_init(&r->active, true);
+        for (int i = 0; i < HP_SLOTS; i++)
+            atomic_init(&r->hp[i], NULL);
+        r->next = atomic_load(&hp_records);
+        while (!atomic_compare_exchange_weak(&hp_records, &r->next, r))
+            ;
+        atomic_fetch_add(&hp_nrecords, 1);
+    }
+    hp_self = r;
+    pthread_setspecific(hp_key, r);
+    return r;
+}
+
+/* Load *@src into hazard pointer @slot, until it is stable */
+static lfq_node_t *hp_protect(hp_rec_t *self,
+                              int slot,
+                              _Atomic(lfq_node_t *) *src)
+{
+    lfq_node_t *p = atomic_load(src), *q;
+    for (;;) {
+        atomic_store(&self->hp[slot], p);
+        q = atomic_load(src);
+        if (q == p)
+            return p;
+        p = q;
+    }
+}
+
+static lfq_node_t *node_new(element_t *e)
+{
+    lfq_node_t *node = malloc(sizeof(lfq_node_t));
+    if (!node)
+        return NULL;
+    atomic_init(&node->next, NULL);
+    node->e = e;
+    return node;
+}
+
+lfq_t *lfq_new()
+{
+    lfq_t *q = aligned_alloc(LFQ_CACHE_LINE, sizeof(lfq_t));
+    if (!q)
+        return NULL;
+    lfq_node_t *dummy = node_new(NULL);
+    if (!dummy) {
+        free(q);
+        return NULL;
+    }
+    atomic_init(&q->head, dummy);
+    atomic_init(&q->tail, dummy);
+    return q;
+}
+
+void lfq_free(lfq_t *q)
+{
+    if (!q)
+        return;
+    lfq_node_t *node = atomic_load(&q->head);
+    while (node) {
+        lfq_node_t *next = atomic_load(&node->next);
+        /* The element of the dummy node has been handed out already */
+        if (next)
+            lfq_release_element(next->e);
+        free(node);
+        node = next;
+    }
+    free(q);
+}
+
+bool lfq_insert_tail(lfq_t *q, const char *s)
+{
+    if (!q || !s)
+        return false;
+    hp_rec_t *self = hp_acquire();
+    if (!self)
+        return false;
+
+    size_t len = strlen(s);
+    element_t *e = malloc(sizeof(element_t) + len + 1);
+    if (!e)
+        return false;
+    e->value = memcpy(e->buf, s, len + 1);
+    e->len = len;
+    e->pooled = false;
+    e->key = key_of(s);
+    e->chunk = NULL;
+    INIT_LIST_HEAD(&e->list);
+
+    lfq_node_t *node = node_new(e);
+    if (!node) {
+        free(e);
+        return false;
+    }
+
+    lfq_node_t *tail;
+    for (;;) {
+        tail = hp_protect(self, 0, &q->tail);
+        lfq_node_t *next = atomic_load(&tail->next);
+        if (tail != atomic_load(&q->tail))
+            continue;
+        if (next) {
+            /* Help a stalled insertion by swinging the tail forward */
+            atomic_compare_exchange_strong(&q->tail, &tail, next);
+            continue;
+        }
+        if (atomic_compare_exchange_strong(&tail->next, &next, node))
+            break;
+    }
+    atomic_compare_exchange_strong(&q->tail, &tail, node);
+    atomic_store(&self->hp[0], NULL);
+    return true;
+}
+
+element_t *lfq_remove_head(lfq_t *q, char *sp, size_t bufsize)
+{
+    if (!q)
+        return NULL;
+    hp_rec_t *self = hp_acquire();
+    if (!self)
+        return NULL;
+
+    lfq_node_t *head;
+    element_t *e;
+    for (;;) {
+        head = hp_protect(self, 0, &q->head);
+        lfq_node_t *tail = atomic_load(&q->tail);
+        lfq_node_t *next = atomic_load(&head->next);
+        atomic_store(&self->hp[1], next);
+        if (head != atomic_load(&q->head))
+            continue;
+        if (!next) {
+            atomic_store(&self->hp[0], NULL);
+            return NULL;
+        }
+        if (head == tail) {
+            atomic_compare_exchange_strong(&q->tail, &tail, next);
+            continue;
+        }
+        /* @next becomes the dummy node, only its element is taken */
+        e = next->e;
+        if (atomic_compare_exchange_strong(&q->head, &head, next))
+            break;
+    }
+    atomic_store(&self->hp[0], NULL);
+    atomic_store(&self->hp[1], NULL);
+    hp_retire(self, head);
+
+    if (sp)
+        copy_value(sp, bufsize, e);
+    return e;
+}
+
+void lfq_release_element(element_t *e)
+{
+    free(e);
+}
+
+void lfq_thread_exit()
+{
+    if (!hp_self)
+        return;
+    hp_release(hp_self);
+    hp_self = NULL;
+    pthread_setspecific(hp_key, NULL);
+}
@@ -0,0 +1,103 @@
+#ifndef LAB0_LFQUEUE_H
+#define LAB0_LFQUEUE_H
+
+/* Lock-free multi-producer/multi-consumer queue of elements.
+ *
+ * A Michael-Scott queue: a singly-linked list of nodes, always holding one
+ * dummy node at the head, with the head and tail pointers advanced by
+ * compare-and-swap. Any number of threads may insert at the tail and remove
+ * from the head concurrently without taking a lock.
+ *
+ * A node which has been unlinked from the head may still be read by threads
+ * that loaded the head before it moved, so it is not freed right away.
+ * Every thread publishes the nodes it is about to dereference as hazard
+ * pointers, and unlinked nodes are only freed once no hazard pointer refers
+ * to them.
+ *
+ * Elements are allocated with the regular malloc, never from a per-queue
+ * arena nor through the allocation checker of harness.c, neither of which
+ * is thread-safe. Release them with lfq_release_element(), not with
+ * q_release_element(). Strings are always copied, intern and pool modes are
+ * ignored.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "queue.h"
+
+/* Keeps the head and the tail of a queue on separate cache lines */
+#define LFQ_CACHE_LINE 64
+
+typedef struct __lfq_node lfq_node_t;
+
+/**
+ * lfq_t - Lock-free queue
+ * @head: the dummy node, whose successor is the first element
+ * @tail: the last node, or lagging one node behind it
+ */
+typedef struct {
+    _Alignas(LFQ_CACHE_LINE) _Atomic(lfq_node_t *) head;
+    _Alignas(LFQ_CACHE_LINE) _Atomic(lfq_node_t *) tail;
+} lfq_t;
+
+/**
+ * lfq_new() - Create an empty queue
+ *
+ * Return: NULL for allocation failed
+ */
+lfq_t *lfq_new();
+
+/**
+ * lfq_free() - Free all storage used by queue
+ * @q: queue to be deleted
+ *
+ * The remaining elements are released as well. No other thread may be
+ * operating on @q.
+ */
+void lfq_free(lfq_t *q);
+
+/**
+ * lfq_insert_tail() - Insert an element at the tail
+ * @q: queue
+ * @s: string to be copied and inserted into the queue
+ *
+ * Safe to call from any number of threads concurrently with each other and
+ * with lfq_remove_head().
+ *
+ * Return: true for success, false for allocation failed or queue is NULL
+ */
+bool lfq_insert_tail(lfq_t *q, const char *s);
+
+/**
+ * lfq_remove_head() - Remove the element from the head
+ * @q: queue
+ * @sp: string would be inserted
+ * @bufsize: size of the string
+ *
+ * Same semantics as q_remove_head(): the removed element is handed over to
+ * the caller, and its string is copied into @sp if @sp is non-NULL. Safe to
+ * call from any number of threads concurrently.
+ *
+ * Return: the removed element, NULL if the queue was empty or NULL
+ */
+element_t *lfq_remove_head(lfq_t *q, char *sp, size_t bufsize);
+
+/**
+ * lfq_release_element() - Release an element removed by lfq_remove_head()
+ * @e: element to be released, may be NULL
+ */
+void lfq_release_element(element_t *e);
+
+/**
+ * lfq_thread_exit() - Hand back the reclamation state of the calling thread
+ *
+ * Frees the unlinked nodes of the calling thread that are no longer
+ * referenced and makes its hazard pointer record available to other
+ * threads. Called automatically when a thread created with pthread_create()
+ * exits; call it explicitly from threads which are not.
+ */
+void lfq_thread_exit();
+
+#endif /* LAB0_LFQUEUE_H */
@@ -0,0 +1,349 @@
+/* Multi-producer/multi-consumer stress test and benchmark
+ *
+ * Producers insert distinct strings at the tail of a shared queue while
+ * consumers remove them from the head, for a range of thread counts up to
+ * the number of cores. Three queues are compared: the lock-free one from
+ * lfqueue.c, the two-lock wrapper from cqueue.c, and the queue.h backend of
+ * the build behind a global mutex.
+ *
+ * Every run is checked as it goes: each item must be received exactly once,
+ * and the items of any one producer must reach any one consumer in the
+ * order they were inserted. Run it with 'make mpmc', or for instance:
+ * ./qmpmc -n 100000 -t 4
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Our program needs to use regular malloc/free */
+#define INTERNAL 1
+#include "harness.h"
+
+#include "cqueue.h"
+#include "lfqueue.h"
+#include "queue.h"
+
+/* Items are decimal numbers, well below 20 digits */
+#define ITEM_LEN 24
+
+typedef struct {
+    const char *name;
+    void *(*new)();
+    void (*free)(void *q);
+    bool (*insert_tail)(void *q, const char *s);
+    bool (*remove_head)(void *q, char *sp, size_t bufsize);
+} mpmc_ops_t;
+
+/* The queue.h backend, serialized by a global mutex */
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *locked_new()
+{
+    return q_new();
+}
+
+static void locked_free(void *q)
+{
+    q_free(q);
+}
+
+static bool locked_insert_tail(void *q, const char *s)
+{
+    pthread_mutex_lock(&queue_lock);
+    bool ok = q_insert_tail(q, (char *) s);
+    pthread_mutex_unlock(&queue_lock);
+    return ok;
+}
+
+static bool locked_remove_head(void *q, char *sp, size_t bufsize)
+{
+    pthread_mutex_lock(&queue_lock);
+    element_t *e = q_remove_head(q, sp, bufsize);
+    if (e)
+        q_release_element(e);
+    pthread_mutex_unlock(&queue_lock);
+    return e;
+}
+
+/* The two-lock wrapper, with separate locks for the head and the tail */
+static void *twolock_new()
+{
+    return cq_new();
+}
+
+static void twolock_free(void *q)
+{
+    cq_free(q);
+}
+
+static bool twolock_insert_tail(void *q, const char *s)
+{
+    return cq_insert_tail(q, (char *) s);
+}
+
+static bool twolock_remove_head(void *q, char *sp, size_t bufsize)
+{
+    element_t *e = cq_remove_head(q, sp, bufsize);
+    cq_release_element(q, e);
+    return e;
+}
+
+/* The lock-free queue */
+static void *lockfree_new()
+{
+    return lfq_new();
+}
+
+static void lockfree_free(void *q)
+{
+    lfq_free(q);
+}
+
+static bool lockfree_insert_tail(void *q, const char *s)
+{
+    return lfq_insert_tail(q, s);
+}
+
+static bool lockfree_remove_head(void *q, char *sp, size_t bufsize)
+{
+    element_t *e = lfq_remove_head(q, sp, bufsize);
+    lfq_release_element(e);
+    return e;
+}
+
+static const mpmc_ops_t variants[] = {
+    {"lock-free", lockfree_new, lockfree_free, lockfree_insert_tail,
+     lockfree_remove_head},
+    {"two-lock", twolock_new, twolock_free, twolock_insert_tail,
+     twolock_remove_head},
+    {"mutex", locked_new, locked_free, locked_insert_tail, locked_remove_head},
+};
+
+/**
+ * run_t - State shared by the threads of one run
+ * @ops: the queue under test
+ * @q: the shared queue
+ * @n: number of items, split evenly among the producers
+ * @producers: number of producer threads
+ * @per_producer: number of items inserted by each producer
+ * @consumed: number of items removed so far
+ * @seen: number of times each item was received
+ * @errors: number of items received twice or out of order
+ * @start: released once every thread is ready
+ */
+typedef struct {
+    const mpmc_ops_t *ops;
+    void *q;
+    long n;
+    int producers;
+    long per_producer;
+    atomic_long consumed;
+    atomic_char *seen;
+    atomic_long errors;
+    pthread_barrier_t start;
+} run_t;
+
+typedef struct {
+    run_t *run;
+    int id;
+} worker_t;
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *producer(void *arg)
+{
+    worker_t *w = arg;
+    run_t *run = w->run;
+    char item[ITEM_LEN];
+    long first = w->id * run->per_producer;
+
+    pthread_barrier_wait(&run->start);
+    for (long i = first; i < first + run->per_producer; i++) {
+        snprintf(item, sizeof(item), "%ld", i);
+        while (!run->ops->insert_tail(run->q, item))
+            sched_yield();
+    }
+    lfq_thread_exit();
+    return NULL;
+}
+
+static void *consumer(void *arg)
+{
+    worker_t *w = arg;
+    run_t *run = w->run;
+    char item[ITEM_LEN];
+    long *last = malloc(sizeof(long) * run->producers);
+    for (int p = 0; p < run->producers; p++)
+        last[p] = -1;
+
+    pthread_barrier_wait(&run->start);
+    while (atomic_load(&run->consumed) < run->n) {
+        if (!run->ops->remove_head(run->q, item, sizeof(item))) {
+            sched_yield();
+            continue;
+        }
+        atomic_fetch_add(&run->consumed, 1);
+
+        long i = strtol(item, NULL, 10);
+        int p = i / run->per_producer;
+        if (i < 0 || i >= run->n || i <= last[p] ||
+            atomic_exchange(&run->seen[i], 1))
+            atomic_fetch_add(&run->errors, 1);
+        else
+            last[p] = i;
+    }
+    free(last);
+    lfq_thread_exit();
+    return NULL;
+}
+
+/* Run @producers and @consumers threads on a fresh queue, return the elapsed
+ * time, or a negative value if the queue misbehaved
+ */
+static double run_once(const mpmc_ops_t *ops,
+                       long n,
+                       int producers,
+                       int consumers)
+{
+    run_t run = {
+        .ops = ops,
+        .q = ops->new(),
+        .n = n / producers * producers,
+        .producers = producers,
+        .per_producer = n / producers,
+    };
+    atomic_init(&run.consumed, 0);
+    atomic_init(&run.errors, 0);
+    run.seen = calloc(run.n, sizeof(atomic_char));
+    if (!run.q || !run.seen) {
+        fprintf(stderr, "%s: allocation failed\n", ops->name);
+        exit(1);
+    }
+    pthread_barrier_init(&run.start, NULL, producers + consumers + 1);
+
+    int nthreads = producers + consumers;
+    pthread_t *threads = malloc(sizeof(pthread_t) * nthreads);
+    worker_t *workers = malloc(sizeof(worker_t) * nthreads);
+    for (int i = 0; i < nthreads; i++) {
+        workers[i].run = &run;
+        workers[i].id = i < producers ? i : i - producers;
+        pthread_create(&threads[i], NULL, i < producers ? producer : consumer,
+                       &workers[i]);
+    }
+
+    pthread_barrier_wait(&run.start);
+    double start = now();
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+    double t = now() - start;
+
+    long missing = 0;
+    for (long i = 0; i < run.n; i++)
+        missing += !atomic_load(&run.seen[i]);
+    long errors = atomic_load(&run.errors);
+    if (missing || errors) {
+        printf("%s: %d producers, %d consumers: %ld items missing, "
+               "%ld duplicated or out of order\n",
+               ops->name, producers, consumers, missing, errors);
+        t = -1;
+    }
+
+    ops->free(run.q);
+    pthread_barrier_destroy(&run.start);
+    free(run.seen);
+    free(threads);
+    free(workers);
+    return t;
+}
+
+static void usage(char *cmd)
+{
+    printf("Usage: %s [-h] [-n N] [-r REPS] [-t THREADS]\n", cmd);
+    printf("\t-h          Print this information\n");
+    printf("\t-n N        Number of items per run (default: 1000000)\n");
+    printf("\t-r REPS     Repetitions, the best one is reported (default: 3)\n");
+    printf("\t-t THREADS  Most producers and consumers "
+           "(default: number of cores)\n");
+    exit(0);
+}
+
+/* Thread counts to try: the powers of two below @max, and @max */
+static int next_count(int count, int max)
+{
+    return count < max && count * 2 > max ? max : count * 2;
+}
+
+int main(int argc, char *argv[])
+{
+    long n = 1000000;
+    int reps = 3, max = sysconf(_SC_NPROCESSORS_ONLN);
+    int c;
+
+    while ((c = getopt(argc, argv, "hn:r:t:")) != -1) {
+        switch (c) {
+        case 'n':
+            n = atol(optarg);
+            break;
+        case 'r':
+            reps = atoi(optarg);
+            break;
+        case 't':
+            max = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            break;
+        }
+    }
+    if (n <= 0 || reps <= 0 || max <= 0 || n < max)
+        usage(argv[0]);
+
+    /* Block-by-block verification of every free is far too slow here */
+    set_cautious_mode(false);
+
+    int failed = 0;
+    printf("%9s %9s", "producers", "consumers");
+    for (size_t v = 0; v < sizeof(variants) / sizeof(variants[0]); v++)
+        printf(" %12s", variants[v].name);
+    printf("   (Mops/s)\n");
+    for (int p = 1; p <= max; p = next_count(p, max)) {
+        for (int cs = 1; cs <= max; cs = next_count(cs, max)) {
+            printf("%9d %9d", p, cs);
+            fflush(stdout);
+            for (size_t v = 0; v < sizeof(variants) / sizeof(variants[0]);
+                 v++) {
+                double best = 0;
+                for (int r = 0; r < reps; r++) {
+                    double t = run_once(&variants[v], n, p, cs);
+                    if (t < 0) {
+                        failed = 1;
+                        break;
+                    }
+                    if (!r || t < best)
+                        best = t;
+                }
+                printf(" %12.2f", best > 0 ? n / p * p / best * 1e-6 : 0);
+                fflush(stdout);
+            }
+            printf("\n");
+        }
+    }
+
+    if (allocation_check()) {
+        printf("mutex: leaked %lu blocks\n", allocation_check());
+        failed = 1;
+    }
+    return failed;
+}
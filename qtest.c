@@ -43,6 +43,8 @@ extern int show_entropy;
  * solution code
  */
 #include "queue.h"
+#include "reclaim.h"
+#include "snapshot.h"
 
 #include "console.h"
 #include "report.h"
@@ -75,6 +77,12 @@ static int string_length = MAXSTRING;
 
 static int descend = 0;
 
+/* Number of threads q_sort() uses */
+static int sort_threads = 1;
+
+/* Whether freed queues are released by the reclaimer thread */
+static int async_free = 0;
+
 #define MIN_RANDSTR_LEN 5
 #define MAX_RANDSTR_LEN 10
 static const char charset[] = "abcdefghijklmnopqrstuvwxyz";
@@ -113,9 +121,12 @@ static bool do_free(int argc, char *argv[])
     if (current) {
         list_del(&current->chain);
 
-        if (exception_setup(true))
-            q_free(current->q);
-        exception_cancel();
+        bool cautious = current->size <= BIG_LIST_SIZE;
+        if (!async_free || !reclaim_queue(current->q, cautious)) {
+            if (exception_setup(true))
+                q_free(current->q);
+            exception_cancel();
+        }
         set_cautious_mode(true);
     }
 
@@ -178,6 +189,85 @@ static void fill_rand_string(char *buf, size_t buf_size)
     buf[len] = '\0';
 }
 
+/* Insert @reps strings with a single bulk call and check the new elements.
+ * The strings are either all @inserts, or fresh random ones when @need_rand
+ * is set.
+ */
+static bool queue_insert_bulk(position_t pos,
+                              char *inserts,
+                              bool need_rand,
+                              int reps)
+{
+    char **strs = malloc(sizeof(char *) * reps);
+    char *rand_bufs = need_rand ? malloc((size_t) MAX_RANDSTR_LEN * reps) : NULL;
+    if (!strs || (need_rand && !rand_bufs)) {
+        report(1, "INTERNAL ERROR.  Could not allocate space for strings");
+        free(strs);
+        free(rand_bufs);
+        return false;
+    }
+
+    for (int r = 0; r < reps; r++) {
+        strs[r] = inserts;
+        if (need_rand) {
+            strs[r] = rand_bufs + (size_t) r * MAX_RANDSTR_LEN;
+            fill_rand_string(strs[r], MAX_RANDSTR_LEN);
+        }
+    }
+
+    bool ok = true;
+    if (exception_setup(true)) {
+        bool rval = pos == POS_TAIL ? q_insert_tail_bulk(current->q, strs, reps)
+                                    : q_insert_head_bulk(current->q, strs, reps);
+        if (rval) {
+            current->size += reps;
+            /* Check the two elements met first from the end they were
+             * inserted at, like the one-by-one loop checks its first two.
+             */
+            q_iter_t it;
+            element_t *entry = pos == POS_TAIL ? q_last(current->q, &it)
+                                               : q_first(current->q, &it);
+            char *lasts = NULL;
+            for (int r = reps - 1; ok && r >= reps - 2; r--) {
+                char *cur_inserts = entry->value;
+                if (!cur_inserts) {
+                    report(1, "ERROR: Failed to save copy of string in queue");
+                    ok = false;
+                } else if (cur_inserts == strs[r]) {
+                    report(1,
+                           "ERROR: Need to allocate and copy string for new "
+                           "queue element");
+                    ok = false;
+                } else if (!intern_mode && lasts == cur_inserts) {
+                    report(1,
+                           "ERROR: Need to allocate separate string for each "
+                           "queue element");
+                    ok = false;
+                }
+                lasts = cur_inserts;
+                entry = pos == POS_TAIL ? q_prev(&it) : q_next(&it);
+            }
+        } else {
+            fail_count++;
+            if (fail_count < fail_limit)
+                report(2, "Insertion of %d strings failed", reps);
+            else {
+                report(1,
+                       "ERROR: Insertion of %d strings failed (%d failures "
+                       "total)",
+                       reps, fail_count);
+                ok = false;
+            }
+        }
+        ok = ok && !error_check();
+    }
+    exception_cancel();
+
+    free(strs);
+    free(rand_bufs);
+    return ok;
+}
+
 /* insertion */
 static bool queue_insert(position_t pos, int argc, char *argv[])
 {
@@ -224,6 +314,13 @@ static bool queue_insert(position_t pos, int argc, char *argv[])
                pos == POS_TAIL ? "tail" : "head");
     error_check();
 
+    /* Many copies go through the bulk interface in one call */
+    if (current && reps > 1) {
+        ok = queue_insert_bulk(pos, inserts, need_rand, reps);
+        q_show(3);
+        return ok;
+    }
+
     if (current && exception_setup(true)) {
         for (int r = 0; ok && r < reps; r++) {
             if (need_rand)
@@ -232,10 +329,9 @@ static bool queue_insert(position_t pos, int argc, char *argv[])
                                         : q_insert_head(current->q, inserts);
             if (rval) {
                 current->size++;
-                element_t *entry =
-                    pos == POS_TAIL
-                        ? list_last_entry(current->q, element_t, list)
-                        : list_first_entry(current->q, element_t, list);
+                q_iter_t it;
+                element_t *entry = pos == POS_TAIL ? q_last(current->q, &it)
+                                                   : q_first(current->q, &it);
                 char *cur_inserts = entry->value;
                 if (!cur_inserts) {
                     report(1, "ERROR: Failed to save copy of string in queue");
@@ -246,7 +342,7 @@ static bool queue_insert(position_t pos, int argc, char *argv[])
                            "queue element");
                     ok = false;
                     break;
-                } else if (r == 1 && lasts == cur_inserts) {
+                } else if (r == 1 && !intern_mode && lasts == cur_inserts) {
                     report(1,
                            "ERROR: Need to allocate separate string for each "
                            "queue element");
@@ -286,6 +382,113 @@ static bool do_it(int argc, char *argv[])
     return queue_insert(POS_TAIL, argc, argv);
 }
 
+/* How many removed strings the buffer of a bulk removal has room for */
+#define REMOVE_PACK 64
+
+/* Remove up to @count elements with a single bulk call and check them. When
+ * @checks is non-NULL, it is compared to the element a single removal would
+ * have returned.
+ */
+static bool queue_remove_bulk(position_t pos, char *checks, int count)
+{
+    int room = count < REMOVE_PACK ? count : REMOVE_PACK;
+    size_t bufsize = (size_t) room * (string_length + 1);
+    char *removes = malloc(bufsize + STRINGPAD + 1);
+    if (!removes) {
+        report(1,
+               "INTERNAL ERROR.  Could not allocate space for removed strings");
+        return false;
+    }
+    memset(removes, 'X', bufsize + STRINGPAD);
+    removes[bufsize + STRINGPAD] = '\0';
+
+    LIST_HEAD(out);
+    int removed = 0;
+    if (current && exception_setup(true))
+        removed = pos == POS_TAIL ? q_remove_tail_n(current->q, count, &out,
+                                                    removes, bufsize)
+                                  : q_remove_head_n(current->q, count, &out,
+                                                    removes, bufsize);
+    exception_cancel();
+
+    bool ok = true;
+    if (removed) {
+        /* The packed strings follow the order of the list, up to the first
+         * one which did not fit.
+         */
+        char *sp = removes;
+        size_t left = bufsize;
+        element_t *e;
+        int n = 0;
+        list_for_each_entry (e, &out, list) {
+            n++;
+            size_t len = strlen(e->value) + 1;
+            if (!*sp) {
+                if (len < left) {
+                    report(1, "ERROR: Failed to store removed value %s",
+                           e->value);
+                    ok = false;
+                }
+                left = 0;
+            } else if (strcmp(sp, e->value)) {
+                report(1, "ERROR: Stored value %s != removed value %s", sp,
+                       e->value);
+                ok = false;
+                break;
+            } else {
+                sp += len;
+                left -= len;
+            }
+            report(2, "Removed %s from queue", e->value);
+        }
+
+        if (ok && n != removed) {
+            report(1, "ERROR: Removed %d elements, but %d were returned",
+                   removed, n);
+            ok = false;
+        }
+
+        size_t i = bufsize;
+        while (i < bufsize + STRINGPAD && removes[i] == 'X')
+            i++;
+        if (i != bufsize + STRINGPAD) {
+            report(1,
+                   "ERROR: copying of strings in bulk removal overflowed "
+                   "destination buffer.");
+            ok = false;
+        }
+
+        if (ok && checks) {
+            element_t *first = pos == POS_TAIL
+                                   ? list_last_entry(&out, element_t, list)
+                                   : list_first_entry(&out, element_t, list);
+            if (strcmp(first->value, checks)) {
+                report(1, "ERROR: Removed value %s != expected value %s",
+                       first->value, checks);
+                ok = false;
+            }
+        }
+
+        element_t *safe;
+        list_for_each_entry_safe (e, safe, &out, list)
+            q_release_element(e);
+        current->size -= removed;
+    } else {
+        fail_count++;
+        if (!checks && fail_count < fail_limit) {
+            report(2, "Removal from queue failed");
+        } else {
+            report(1, "ERROR: Removal from queue failed (%d failures total)",
+                   fail_count);
+            ok = false;
+        }
+    }
+
+    q_show(3);
+    free(removes);
+    return ok && !error_check();
+}
+
 static bool queue_remove(position_t pos, int argc, char *argv[])
 {
     /* FIXME: It is known that both functions is_remove_tail_const() and
@@ -310,11 +513,25 @@ static bool queue_remove(position_t pos, int argc, char *argv[])
     }
 #endif
 
-    if (argc != 1 && argc != 2) {
-        report(1, "%s needs 0-1 arguments", argv[0]);
+    if (argc < 1 || argc > 3) {
+        report(1, "%s needs 0-2 arguments", argv[0]);
         return false;
     }
 
+    if (argc == 3) {
+        int count;
+        if (!get_int(argv[2], &count) || count <= 0) {
+            report(1, "Invalid number of removals '%s'", argv[2]);
+            return false;
+        }
+        if (!current || !current->size)
+            report(3, "Warning: Calling remove %s on empty queue",
+                   pos == POS_TAIL ? "tail" : "head");
+        error_check();
+        return queue_remove_bulk(pos, strcmp(argv[1], "-") ? argv[1] : NULL,
+                                 count);
+    }
+
     char *removes = malloc(string_length + STRINGPAD + 1);
     if (!removes) {
         report(1,
@@ -415,10 +632,52 @@ static inline bool do_rt(int argc, char *argv[])
     return queue_remove(POS_TAIL, argc, argv);
 }
 
+/* A string of the copy do_dedup() checks against, with its position */
+typedef struct {
+    const char *value;
+    int pos;
+} dup_ref_t;
+
+static int dup_ref_cmp(const void *a, const void *b)
+{
+    return strcmp(((const dup_ref_t *) a)->value,
+                  ((const dup_ref_t *) b)->value);
+}
+
+/* Tell, for each of the @n elements of @l in order, whether its string is
+ * repeated anywhere in the list. Return NULL if no memory.
+ */
+static bool *mark_repeated(struct list_head *l, int n)
+{
+    dup_ref_t *v = malloc(sizeof(dup_ref_t) * (n ? n : 1));
+    bool *repeated = malloc(sizeof(bool) * (n ? n : 1));
+    if (!v || !repeated) {
+        free(v);
+        free(repeated);
+        return NULL;
+    }
+    element_t *item;
+    int i = 0;
+    list_for_each_entry (item, l, list) {
+        v[i].value = item->value;
+        v[i].pos = i;
+        i++;
+    }
+    qsort(v, n, sizeof(dup_ref_t), dup_ref_cmp);
+    for (i = 0; i < n; i++) {
+        repeated[v[i].pos] =
+            (i > 0 && !strcmp(v[i - 1].value, v[i].value)) ||
+            (i + 1 < n && !strcmp(v[i].value, v[i + 1].value));
+    }
+    free(v);
+    return repeated;
+}
+
 static bool do_dedup(int argc, char *argv[])
 {
-    if (argc != 1) {
-        report(1, "%s takes no arguments", argv[0]);
+    bool all = argc == 2 && !strcmp(argv[1], "all");
+    if (argc != 1 && !all) {
+        report(1, "%s takes no arguments but 'all'", argv[0]);
         return false;
     }
 
@@ -429,30 +688,26 @@ static bool do_dedup(int argc, char *argv[])
 
     LIST_HEAD(l_copy);
     element_t *item = NULL, *tmp = NULL;
+    bool *repeated = NULL;
+    q_iter_t it;
 
     // Copy current->q to l_copy
-    if (current->q && !list_empty(current->q)) {
-        list_for_each_entry (item, current->q, list) {
-            size_t slen;
-            tmp = malloc(sizeof(element_t));
+    if (current->q && q_size(current->q)) {
+        for (item = q_first(current->q, &it); item; item = q_next(&it)) {
+            size_t slen = strlen(item->value) + 1;
+            tmp = malloc(sizeof(element_t) + slen);
             if (!tmp)
                 break;
             INIT_LIST_HEAD(&tmp->list);
-            slen = strlen(item->value) + 1;
-            tmp->value = malloc(slen);
-            if (!tmp->value) {
-                free(tmp);
-                break;
-            }
-            memcpy(tmp->value, item->value, slen);
+            tmp->len = slen - 1;
+            tmp->value = memcpy(tmp->buf, item->value, slen);
             list_add_tail(&tmp->list, &l_copy);
         }
         // Return false if the loop does not leave properly
-        if (&item->list != current->q) {
-            list_for_each_entry_safe (item, tmp, &l_copy, list) {
-                free(item->value);
+        if (item ||
+            (all && !(repeated = mark_repeated(&l_copy, q_size(current->q))))) {
+            list_for_each_entry_safe (item, tmp, &l_copy, list)
                 free(item);
-            }
             report(1,
                    "INTERNAL ERROR.  Could not allocate space for "
                    "duplicate checking");
@@ -462,20 +717,21 @@ static bool do_dedup(int argc, char *argv[])
 
     bool ok = true;
     if (exception_setup(true))
-        ok = q_delete_dup(current->q);
+        ok = all ? q_delete_dup_unsorted(current->q)
+                 : q_delete_dup(current->q);
     exception_cancel();
 
     if (!ok) {
-        list_for_each_entry_safe (item, tmp, &l_copy, list) {
-            free(item->value);
+        list_for_each_entry_safe (item, tmp, &l_copy, list)
             free(item);
-        }
+        free(repeated);
         report(1, "ERROR: Calling delete duplicate on null queue");
         return false;
     }
 
-    struct list_head *l_tmp = current->q->next;
+    element_t *l_tmp = q_first(current->q, &it);
     bool is_this_dup = false;
+    int pos = 0;
     // Compare between new list and old one
     list_for_each_entry (item, &l_copy, list) {
         // Skip comparison with new list if the string is duplicate
@@ -483,28 +739,25 @@ static bool do_dedup(int argc, char *argv[])
             item->list.next != &l_copy &&
             strcmp(list_entry(item->list.next, element_t, list)->value,
                    item->value) == 0;
-        if (is_this_dup || is_next_dup) {
+        if (all ? repeated[pos++] : is_this_dup || is_next_dup) {
             // Update list size
             current->size--;
-        } else if (l_tmp != current->q &&
-                   strcmp(list_entry(l_tmp, element_t, list)->value,
-                          item->value) == 0)
-            l_tmp = l_tmp->next;
+        } else if (l_tmp && strcmp(l_tmp->value, item->value) == 0)
+            l_tmp = q_next(&it);
         else
             ok = false;
         is_this_dup = is_next_dup;
     }
     // All elements in new list should be traversed
-    ok = ok && l_tmp == current->q;
+    ok = ok && !l_tmp;
     if (!ok)
         report(1,
                "ERROR: Duplicate strings are in queue or distinct strings are "
                "not in queue");
 
-    list_for_each_entry_safe (item, tmp, &l_copy, list) {
-        free(item->value);
+    list_for_each_entry_safe (item, tmp, &l_copy, list)
         free(item);
-    }
+    free(repeated);
 
     q_show(3);
     return ok && !error_check();
@@ -579,6 +832,34 @@ static bool do_size(int argc, char *argv[])
     return ok && !error_check();
 }
 
+/* Compact the string pool of the current queue and check that the pooled
+ * strings now follow each other in memory, in queue order
+ */
+static bool queue_compact()
+{
+    bool ok = true;
+    if (exception_setup(true)) {
+        if (!q_compact(current->q)) {
+            report(1, "ERROR: Could not compact the strings of queue");
+            ok = false;
+        }
+    }
+    exception_cancel();
+
+    const char *end = NULL;
+    q_iter_t it;
+    for (element_t *e = q_first(current->q, &it); ok && e; e = q_next(&it)) {
+        if (!e->pooled)
+            continue;
+        if (end && e->value != end) {
+            report(1, "ERROR: Pooled strings are not laid out in queue order");
+            ok = false;
+        }
+        end = e->value + e->len + 1;
+    }
+    return ok && !error_check();
+}
+
 bool do_sort(int argc, char *argv[])
 {
     if (argc != 1) {
@@ -605,12 +886,10 @@ bool do_sort(int argc, char *argv[])
 
     bool ok = true;
     if (current && current->size) {
-        for (struct list_head *cur_l = current->q->next;
-             cur_l != current->q && --cnt; cur_l = cur_l->next) {
+        q_iter_t it;
+        element_t *item = q_first(current->q, &it), *next_item;
+        for (; --cnt && (next_item = q_next(&it)); item = next_item) {
             /* Ensure each element in ascending/descending order */
-            element_t *item, *next_item;
-            item = list_entry(cur_l, element_t, list);
-            next_item = list_entry(cur_l->next, element_t, list);
             if (!descend && strcmp(item->value, next_item->value) > 0) {
                 report(1, "ERROR: Not sorted in ascending order");
                 ok = false;
@@ -625,32 +904,193 @@ bool do_sort(int argc, char *argv[])
         }
     }
 
+    /* Compaction allocates, so it happens once the sort itself is done */
+    if (ok && current && pool_mode)
+        ok = queue_compact();
+
     q_show(3);
     return ok && !error_check();
 }
 
-static bool do_dm(int argc, char *argv[])
+static bool do_compact(int argc, char *argv[])
 {
     if (argc != 1) {
         report(1, "%s takes no arguments", argv[0]);
         return false;
     }
 
+    if (!current || !current->q) {
+        report(3, "Warning: Calling compact on null queue");
+        return false;
+    }
+    error_check();
+
+    bool ok = queue_compact();
+    q_show(3);
+    return ok;
+}
+
+static bool do_dm(int argc, char *argv[])
+{
+    if (argc != 1 && argc != 2) {
+        report(1, "%s takes 0-1 arguments", argv[0]);
+        return false;
+    }
+
+    int reps = 1;
+    if (argc == 2 && (!get_int(argv[1], &reps) || reps < 1)) {
+        report(1, "Invalid number of deletions '%s'", argv[1]);
+        return false;
+    }
+
+    if (!current || !current->q) {
+        report(3, "Warning: Try to access null queue");
+        return false;
+    }
+    error_check();
+
+    bool ok = true;
+    if (exception_setup(true)) {
+        for (int r = 0; ok && r < reps; r++) {
+            ok = q_delete_mid(current->q);
+            if (!current->size)
+                report(3, "Warning: Try to delete middle node to empty queue");
+            else
+                --current->size;
+        }
+    }
+    exception_cancel();
+
+    q_show(3);
+    return ok && !error_check();
+}
+
+static bool do_get(int argc, char *argv[])
+{
+    if (argc != 2 && argc != 3) {
+        report(1, "%s needs 1-2 arguments", argv[0]);
+        return false;
+    }
+
+    int i;
+    if (!get_int(argv[1], &i)) {
+        report(1, "Invalid position '%s'", argv[1]);
+        return false;
+    }
+
+    if (!current || !current->q) {
+        report(3, "Warning: Try to access null queue");
+        return false;
+    }
+    error_check();
+
+    element_t *e = NULL;
+    if (exception_setup(true))
+        e = q_at(current->q, i);
+    exception_cancel();
+
+    bool ok = true;
+    bool in_range = i >= 0 && i < current->size;
+    if (!in_range) {
+        report(3, "Warning: Position %d is out of range", i);
+        if (e) {
+            report(1, "ERROR: Got an element at position %d out of range", i);
+            ok = false;
+        }
+    } else if (!e) {
+        report(1, "ERROR: No element returned at position %d", i);
+        ok = false;
+    } else if (argc == 3 && strcmp(e->value, argv[2])) {
+        report(1, "ERROR: Element %d is %s, expected %s", i, e->value,
+               argv[2]);
+        ok = false;
+    } else {
+        report(2, "Element %d = %s", i, e->value);
+    }
+
+    return ok && !error_check();
+}
+
+static bool do_ia(int argc, char *argv[])
+{
+    if (argc != 3) {
+        report(1, "%s needs 2 arguments", argv[0]);
+        return false;
+    }
+
+    int i;
+    if (!get_int(argv[1], &i)) {
+        report(1, "Invalid position '%s'", argv[1]);
+        return false;
+    }
+
     if (!current || !current->q) {
         report(3, "Warning: Try to access null queue");
         return false;
     }
     error_check();
 
+    bool rval = false;
+    if (exception_setup(true))
+        rval = q_insert_at(current->q, i, argv[2]);
+    exception_cancel();
+
     bool ok = true;
+    if (rval) {
+        current->size++;
+    } else if (i >= 0 && i <= current->size) {
+        fail_count++;
+        if (fail_count < fail_limit) {
+            report(2, "Insertion of %s failed", argv[2]);
+        } else {
+            report(1, "ERROR: Insertion of %s failed (%d failures total)",
+                   argv[2], fail_count);
+            ok = false;
+        }
+    } else {
+        report(3, "Warning: Position %d is out of range", i);
+    }
+
+    q_show(3);
+    return ok && !error_check();
+}
+
+static bool do_da(int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+
+    int i;
+    if (!get_int(argv[1], &i)) {
+        report(1, "Invalid position '%s'", argv[1]);
+        return false;
+    }
+
+    if (!current || !current->q) {
+        report(3, "Warning: Try to access null queue");
+        return false;
+    }
+    error_check();
+
+    bool rval = false;
     if (exception_setup(true))
-        ok = q_delete_mid(current->q);
+        rval = q_delete_at(current->q, i);
     exception_cancel();
 
-    if (!current->size)
-        report(3, "Warning: Try to delete middle node to empty queue");
-    else
-        --current->size;
+    bool ok = true;
+    bool in_range = i >= 0 && i < current->size;
+    if (rval != in_range) {
+        report(1, "ERROR: Deletion at position %d %s", i,
+               rval ? "succeeded out of range" : "failed");
+        ok = false;
+    } else if (rval) {
+        current->size--;
+    } else {
+        report(3, "Warning: Position %d is out of range", i);
+    }
+
     q_show(3);
     return ok && !error_check();
 }
@@ -703,17 +1143,15 @@ static bool do_ascend(int argc, char *argv[])
 
     if (exception_setup(true))
         current->size = q_ascend(current->q);
-    set_noallocate_mode(false);
+    exception_cancel();
 
     bool ok = true;
 
     cnt = current->size;
     if (current->size) {
-        for (struct list_head *cur_l = current->q->next;
-             cur_l != current->q && --cnt; cur_l = cur_l->next) {
-            element_t *item, *next_item;
-            item = list_entry(cur_l, element_t, list);
-            next_item = list_entry(cur_l->next, element_t, list);
+        q_iter_t it;
+        element_t *item = q_first(current->q, &it), *next_item;
+        for (; --cnt && (next_item = q_next(&it)); item = next_item) {
             if (strcmp(item->value, next_item->value) > 0) {
                 report(1,
                        "ERROR: At least one node violated the ordering rule");
@@ -750,17 +1188,15 @@ static bool do_descend(int argc, char *argv[])
 
     if (exception_setup(true))
         current->size = q_descend(current->q);
-    set_noallocate_mode(false);
+    exception_cancel();
 
     bool ok = true;
 
     cnt = current->size;
     if (current->size) {
-        for (struct list_head *cur_l = current->q->next;
-             cur_l != current->q && --cnt; cur_l = cur_l->next) {
-            element_t *item, *next_item;
-            item = list_entry(cur_l, element_t, list);
-            next_item = list_entry(cur_l->next, element_t, list);
+        q_iter_t it;
+        element_t *item = q_first(current->q, &it), *next_item;
+        for (; --cnt && (next_item = q_next(&it)); item = next_item) {
             if (strcmp(item->value, next_item->value) < 0) {
                 report(1,
                        "ERROR: At least one node violated the ordering rule");
@@ -817,14 +1253,25 @@ static bool do_merge(int argc, char *argv[])
     }
     error_check();
 
+    /* q_merge() may not allocate, make room for the merged queue first */
     int len = 0;
+    queue_contex_t *ctx;
+    list_for_each_entry (ctx, &chain.head, chain)
+        len += q_size(ctx->q);
+    ctx = list_first_entry(&chain.head, queue_contex_t, chain);
+    if (ctx->q && !q_reserve(ctx->q, len)) {
+        report(1, "ERROR: Could not make room for merging");
+        return false;
+    }
+
+    len = 0;
     set_noallocate_mode(true);
     if (current && exception_setup(true))
         len = q_merge(&chain.head, descend);
     exception_cancel();
     set_noallocate_mode(false);
 
-    if (q_size(&chain.head) > 1) {
+    if (chain.size > 1) {
         chain.size = 1;
         current = list_entry(chain.head.next, queue_contex_t, chain);
         current->size = len;
@@ -843,12 +1290,10 @@ static bool do_merge(int argc, char *argv[])
 
     bool ok = true;
     if (current && current->size) {
-        for (struct list_head *cur_l = current->q->next;
-             cur_l != current->q && --len; cur_l = cur_l->next) {
+        q_iter_t it;
+        element_t *item = q_first(current->q, &it), *next_item;
+        for (; --len && (next_item = q_next(&it)); item = next_item) {
             /* Ensure each element in ascending order */
-            element_t *item, *next_item;
-            item = list_entry(cur_l, element_t, list);
-            next_item = list_entry(cur_l->next, element_t, list);
             if (!descend && strcmp(item->value, next_item->value) > 0) {
                 report(1,
                        "ERROR: Not sorted in ascending order (It might because "
@@ -875,6 +1320,111 @@ static bool do_merge(int argc, char *argv[])
     return ok && !error_check();
 }
 
+/* File save and load use when given none, private to this run and removed
+ * on quit
+ */
+static char snapshot_tmp[] = "/tmp/qtest.XXXXXX";
+static bool snapshot_tmp_made = false;
+
+/* The file named on the command line, or the one of this run */
+static const char *snapshot_path(int argc, char *argv[])
+{
+    if (argc == 2)
+        return argv[1];
+    if (!snapshot_tmp_made) {
+        int fd = mkstemp(snapshot_tmp);
+        if (fd < 0) {
+            report(1, "ERROR: Could not create a snapshot file: %s",
+                   strerror(errno));
+            return NULL;
+        }
+        close(fd);
+        snapshot_tmp_made = true;
+    }
+    return snapshot_tmp;
+}
+
+static bool do_save(int argc, char *argv[])
+{
+    if (argc != 1 && argc != 2) {
+        report(1, "%s takes 0-1 arguments", argv[0]);
+        return false;
+    }
+
+    if (!current || !current->q) {
+        report(3, "Warning: Calling save on null queue");
+        return false;
+    }
+    error_check();
+
+    const char *path = snapshot_path(argc, argv);
+    if (!path)
+        return false;
+    if (!snapshot_save(current->q, path)) {
+        report(1, "ERROR: Could not save queue to '%s': %s", path,
+               strerror(errno));
+        return false;
+    }
+    return !error_check();
+}
+
+static bool do_load(int argc, char *argv[])
+{
+    if (argc != 1 && argc != 2) {
+        report(1, "%s takes 0-1 arguments", argv[0]);
+        return false;
+    }
+
+    if (!current || !current->q) {
+        report(3, "Warning: Calling load on null queue");
+        return false;
+    }
+    error_check();
+
+    const char *path = snapshot_path(argc, argv);
+    snapshot_t snap;
+    if (!path)
+        return false;
+    if (!snapshot_open(&snap, path)) {
+        report(1, "ERROR: Could not load queue from '%s': %s", path,
+               strerror(errno));
+        return false;
+    }
+
+    bool ok = true;
+    if (snap.n && exception_setup(true)) {
+        if (q_insert_tail_bulk(current->q, snap.strs, snap.n)) {
+            current->size += snap.n;
+            /* The queue must hold copies of exactly the saved strings */
+            q_iter_t it;
+            element_t *e = q_last(current->q, &it);
+            for (int i = snap.n - 1; ok && i >= 0; i--, e = q_prev(&it)) {
+                if (e->value == snap.strs[i] || strcmp(e->value, snap.strs[i]))
+                    ok = false;
+            }
+            if (!ok)
+                report(1, "ERROR: Loaded queue does not match '%s'", path);
+        } else {
+            fail_count++;
+            if (fail_count < fail_limit)
+                report(2, "Insertion of %d strings failed", snap.n);
+            else {
+                report(1,
+                       "ERROR: Insertion of %d strings failed (%d failures "
+                       "total)",
+                       snap.n, fail_count);
+                ok = false;
+            }
+        }
+        ok = ok && !error_check();
+    }
+    exception_cancel();
+    snapshot_close(&snap);
+
+    q_show(3);
+    return ok;
+}
+
 static bool is_circular()
 {
     struct list_head *cur = current->q->next;
@@ -912,12 +1462,11 @@ static bool q_show(int vlevel)
 
     report_noreturn(vlevel, "l = [");
 
-    struct list_head *ori = current->q;
-    struct list_head *cur = current->q->next;
+    q_iter_t it;
+    element_t *e = q_first(current->q, &it);
 
     if (exception_setup(true)) {
-        while (ok && ori != cur && cnt < current->size) {
-            element_t *e = list_entry(cur, element_t, list);
+        while (ok && e && cnt < current->size) {
             if (cnt < BIG_LIST_SIZE) {
                 report_noreturn(vlevel, cnt == 0 ? "%s" : " %s", e->value);
                 if (show_entropy) {
@@ -927,7 +1476,7 @@ static bool q_show(int vlevel)
                 }
             }
             cnt++;
-            cur = cur->next;
+            e = q_next(&it);
             ok = ok && !error_check();
         }
     }
@@ -938,7 +1487,7 @@ static bool q_show(int vlevel)
         return false;
     }
 
-    if (cur == ori) {
+    if (!e) {
         if (cnt <= BIG_LIST_SIZE)
             report(vlevel, "]");
         else
@@ -1012,6 +1561,25 @@ static bool do_next(int argc, char *argv[])
     return q_show(0);
 }
 
+/* Start the sorting threads once the option changes, not when sorting */
+static void set_sort_threads(int oldval)
+{
+    int n = sort_set_threads(sort_threads);
+    if (n != sort_threads)
+        report(1, "Sorting with %d threads", n);
+    sort_threads = n;
+}
+
+static void set_async_free(int oldval)
+{
+    if (!async_free) {
+        reclaim_stop();
+    } else if (!reclaim_start()) {
+        report(1, "Could not start the reclaimer thread");
+        async_free = 0;
+    }
+}
+
 static void console_init()
 {
     ADD_COMMAND(new, "Create new queue", "");
@@ -1028,19 +1596,44 @@ static void console_init()
                 "str [n]");
     ADD_COMMAND(
         rh,
-        "Remove from head of queue. Optionally compare to expected value str",
-        "[str]");
+        "Remove from head of queue. Optionally compare to expected value str. "
+        "With n, remove n elements at once and compare str to the first one, "
+        "unless str equals -",
+        "[str [n]]");
     ADD_COMMAND(
         rt,
-        "Remove from tail of queue. Optionally compare to expected value str",
-        "[str]");
+        "Remove from tail of queue. Optionally compare to expected value str. "
+        "With n, remove n elements at once and compare str to the first one, "
+        "unless str equals -",
+        "[str [n]]");
     ADD_COMMAND(reverse, "Reverse queue", "");
     ADD_COMMAND(sort, "Sort queue in ascending/descening order", "");
     ADD_COMMAND(size, "Compute queue size n times (default: n == 1)", "[n]");
     ADD_COMMAND(show, "Show queue contents", "");
-    ADD_COMMAND(dm, "Delete middle node in queue", "");
-    ADD_COMMAND(dedup, "Delete all nodes that have duplicate string", "");
+    ADD_COMMAND(dm, "Delete middle node in queue n times (default: n == 1)",
+                "[n]");
+    ADD_COMMAND(get,
+                "Show the element at position i. Optionally compare to "
+                "expected value str",
+                "i [str]");
+    ADD_COMMAND(ia, "Insert string str at position i of queue", "i str");
+    ADD_COMMAND(da, "Delete the element at position i of queue", "i");
+    ADD_COMMAND(dedup,
+                "Delete all nodes that have duplicate string, next to each "
+                "other or with 'all', anywhere in the queue",
+                "[all]");
     ADD_COMMAND(merge, "Merge all the queues into one sorted queue", "");
+    ADD_COMMAND(compact,
+                "Lay out the pooled strings of queue back to back, in order",
+                "");
+    ADD_COMMAND(save,
+                "Save the strings of queue to binary file, by default one "
+                "private to this run",
+                "[file]");
+    ADD_COMMAND(load,
+                "Insert the strings saved in file at tail of queue, by "
+                "default the one private to this run",
+                "[file]");
     ADD_COMMAND(swap, "Swap every two adjacent nodes in queue", "");
     ADD_COMMAND(ascend,
                 "Remove every node which has a node with a strictly less "
@@ -1060,6 +1653,19 @@ static void console_init()
               "Number of times allow queue operations to return false", NULL);
     add_param("descend", &descend,
               "Sort and merge queue in ascending/descending order", NULL);
+    add_param("sortalgo", &sort_algo,
+              "Sorting algorithm (0: merge sort, 1: MSD radix sort)", NULL);
+    add_param("threads", &sort_threads,
+              "Number of threads sorting long queues in parallel",
+              set_sort_threads);
+    add_param("intern", &intern_mode,
+              "Share one copy of equal strings between elements", NULL);
+    add_param("pool", &pool_mode,
+              "Copy strings into a pool per queue, compacted after sorting",
+              NULL);
+    add_param("async", &async_free,
+              "Free queues on a background thread, without waiting",
+              set_async_free);
 }
 
 /* Signal handlers */
@@ -1100,7 +1706,9 @@ static bool q_quit(int argc, char *argv[])
         while (chain.size > 0) {
             queue_contex_t *qctx = list_entry(cur, queue_contex_t, chain);
             cur = cur->next;
-            q_free(qctx->q);
+            if (!async_free ||
+                !reclaim_queue(qctx->q, qctx->size <= BIG_LIST_SIZE))
+                q_free(qctx->q);
             free(qctx);
             chain.size--;
         }
@@ -1108,6 +1716,10 @@ static bool q_quit(int argc, char *argv[])
 
     exception_cancel();
     set_cautious_mode(true);
+    sort_set_threads(1);
+    reclaim_stop();
+    if (snapshot_tmp_made)
+        unlink(snapshot_tmp);
 
     size_t bcnt = allocation_check();
     if (bcnt > 0) {
@@ -2,7 +2,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "element.h"
 #include "queue.h"
+#include "skiplist.h"
+#include "sort.h"
 
 /* Notice: sometimes, Cppcheck would find the potential NULL pointer bugs,
  * but some of them cannot occur. You can suppress them by adding the
@@ -10,15 +13,98 @@
  *   cppcheck-suppress nullPointer
  */
 
+/* The queue header handed out by q_new(). The list head stays in the first
+ * position so that callers keep working with a plain struct list_head *,
+ * while the element count travels along with it and makes q_size() O(1).
+ * @mid points to the middle node when it is known, see track_insert(), and
+ * @index gives positional access while @indexed is set, see index_ready().
+ */
+typedef struct {
+    struct list_head head;
+    int size;
+    struct list_head *mid;
+    skiplist_t index;
+    bool indexed;
+    arena_t arena;
+} queue_t;
+
+static inline queue_t *queue_of(struct list_head *head)
+{
+    return container_of(head, queue_t, head);
+}
+
+/* The middle of a queue of n elements is node (n - 1) / 2 counting from 0,
+ * the one q_delete_mid() deletes. Whether it moves when an end of the queue
+ * changes only depends on the parity of the size, so q->mid follows it in
+ * constant time through insertions and removals at either end. The skip
+ * index, once built, follows those in O(log n).
+ *
+ * Operations moving elements around merely forget both. q_delete_mid() finds
+ * the middle again with a walk from the closer end, and the index is rebuilt
+ * by the next positional access. Forgetting never releases memory, as it also
+ * happens while allocation is disallowed.
+ */
+static inline void order_changed(queue_t *q)
+{
+    q->mid = NULL;
+    q->indexed = false;
+}
+
+/* Call after @node is linked at one end, before it is counted in q->size */
+static inline void track_insert(queue_t *q, struct list_head *node, bool tail)
+{
+    if (!q->size)
+        q->mid = node;
+    else if (q->mid && tail && !(q->size & 1))
+        q->mid = q->mid->next;
+    else if (q->mid && !tail && (q->size & 1))
+        q->mid = q->mid->prev;
+
+    if (q->indexed &&
+        !skip_insert(&q->index, &q->arena, tail ? q->size : 0, node))
+        q->indexed = false;
+}
+
+/* Call before the node at one end is unlinked and uncounted */
+static inline void track_remove(queue_t *q, bool tail)
+{
+    if (q->size == 1)
+        q->mid = NULL;
+    else if (q->mid && !tail && !(q->size & 1))
+        q->mid = q->mid->next;
+    else if (q->mid && tail && (q->size & 1))
+        q->mid = q->mid->prev;
+
+    if (q->indexed)
+        skip_delete(&q->index, tail ? q->size - 1 : 0);
+}
+
+/* Make the skip index of @q match the queue, rebuilding it if it was
+ * forgotten. Return false if there is no memory for it.
+ */
+static bool index_ready(queue_t *q)
+{
+    if (!q->indexed) {
+        skip_drop(&q->index);
+        q->indexed = skip_build(&q->index, &q->arena, &q->head);
+    }
+    return q->indexed;
+}
 
 /* Create an empty queue */
 struct list_head *q_new()
 {
-    struct list_head *head = malloc(sizeof(struct list_head));
-    if (head != NULL) {
-        INIT_LIST_HEAD(head);
-    }
-    return head;
+    queue_t *q = malloc(sizeof(queue_t));
+    if (!q)
+        return NULL;
+
+    INIT_LIST_HEAD(&q->head);
+    q->size = 0;
+    q->mid = NULL;
+    skip_init(&q->index);
+    q->indexed = false;
+    arena_init(&q->arena);
+    return &q->head;
 }
 
 /* Free all storage used by queue */
@@ -26,11 +112,26 @@ void q_free(struct list_head *head)
 {
     if (!head)
         return;
-    element_t *cur, *next;
-    list_for_each_entry_safe (cur, next, head, list) {
-        q_release_element(cur);
+
+    /* Every element lives in the arena, there is no need to visit them one
+     * by one unless some of them hold references to interned strings.
+     */
+    queue_t *q = queue_of(head);
+    if (intern_count()) {
+        element_t *e;
+        list_for_each_entry (e, head, list) {
+            if (element_interned(e))
+                intern_put(e->value);
+        }
     }
-    free(head);
+    arena_destroy(&q->arena);
+    free(q);
+}
+
+/* Make room for n elements in queue, the list needs no memory ahead of time */
+bool q_reserve(struct list_head *head, int n)
+{
+    return head;
 }
 
 /* Insert an element at head of queue */
@@ -39,17 +140,13 @@ bool q_insert_head(struct list_head *head, char *s)
     if (!head)
         return false;
 
-    element_t *new_element = malloc(sizeof(element_t));
+    element_t *new_element = element_new(&queue_of(head)->arena, s);
     if (!new_element)
         return false;
 
-    new_element->value = strdup(s);
-    if (!new_element->value) {
-        free(new_element);
-        return false;
-    }
-
     list_add(&new_element->list, head);
+    track_insert(queue_of(head), &new_element->list, false);
+    queue_of(head)->size++;
     return true;
 }
 
@@ -59,18 +156,99 @@ bool q_insert_tail(struct list_head *head, char *s)
     if (!head)
         return false;
 
-    element_t *new_element = malloc(sizeof(element_t));
+    element_t *new_element = element_new(&queue_of(head)->arena, s);
     if (!new_element)
         return false;
 
-    new_element->value = strdup(s);
-    if (!new_element->value) {
-        free(new_element);
+    list_add_tail(&new_element->list, head);
+    track_insert(queue_of(head), &new_element->list, true);
+    queue_of(head)->size++;
+    return true;
+}
+
+/* Number of strings insert_bulk() lays out per block. Their lengths are kept
+ * on the stack between sizing the block and filling it, and the block is
+ * small enough to still be in cache when it is filled.
+ */
+#define BULK_BATCH 256
+
+/* Insert copies of the @n strings in @s as a chain spliced in at once.
+ *
+ * Elements which fit a size class are laid out back to back in one block
+ * from the arena per batch, larger ones are allocated one by one. The chain
+ * is linked in the order the elements would end up after inserting the
+ * strings one at a time, so only the final splice touches the queue itself.
+ */
+static bool insert_bulk(struct list_head *head, char *s[], int n, bool tail)
+{
+    if (!head || n < 0 || (n && !s))
         return false;
+
+    queue_t *q = queue_of(head);
+    LIST_HEAD(chain);
+    for (int i = 0; i < n; i += BULK_BATCH) {
+        int batch = n - i < BULK_BATCH ? n - i : BULK_BATCH;
+        size_t lens[BULK_BATCH], total = 0;
+        for (int j = 0; j < batch; j++) {
+            lens[j] = strlen(s[i + j]);
+            size_t size = element_size(lens[j]);
+            if (size <= ARENA_MAX_OBJECT)
+                total += arena_round_up(size);
+        }
+
+        arena_chunk_t *chunk = NULL;
+        char *block = NULL;
+        if (total && !(block = arena_alloc_block(&q->arena, total, &chunk)))
+            goto fail;
+
+        for (int j = 0; j < batch; j++) {
+            size_t size = element_size(lens[j]);
+            element_t *e;
+            if (size <= ARENA_MAX_OBJECT) {
+                e = (element_t *) block;
+                block += arena_round_up(size);
+                if (!element_init(e, chunk, s[i + j], lens[j]))
+                    goto fail;
+            } else if (!(e = element_new(&q->arena, s[i + j]))) {
+                goto fail;
+            }
+            if (tail)
+                list_add_tail(&e->list, &chain);
+            else
+                list_add(&e->list, &chain);
+        }
     }
 
-    list_add_tail(&new_element->list, head);
+    if (tail)
+        list_splice_tail(&chain, head);
+    else
+        list_splice(&chain, head);
+    q->size += n;
+    order_changed(q);
     return true;
+
+fail:
+    /* Undo the whole call, the queue is left untouched. The part of the
+     * last block never carved is reclaimed with the arena.
+     */
+    {
+        element_t *entry, *safe;
+        list_for_each_entry_safe (entry, safe, &chain, list)
+            q_release_element(entry);
+    }
+    return false;
+}
+
+/* Insert an array of strings at head of queue */
+bool q_insert_head_bulk(struct list_head *head, char *s[], int n)
+{
+    return insert_bulk(head, s, n, false);
+}
+
+/* Insert an array of strings at tail of queue */
+bool q_insert_tail_bulk(struct list_head *head, char *s[], int n)
+{
+    return insert_bulk(head, s, n, true);
 }
 
 /* Remove an element from head of queue */
@@ -78,12 +256,12 @@ element_t *q_remove_head(struct list_head *head, char *sp, size_t bufsize)
 {
     if (head && !list_empty(head)) {
         element_t *to_remove = list_first_entry(head, element_t, list);
+        track_remove(queue_of(head), false);
         list_del(&to_remove->list);
+        queue_of(head)->size--;
 
-        if (sp) {
-            strncpy(sp, to_remove->value, bufsize - 1);
-            sp[bufsize - 1] = '\0';
-        }
+        if (sp)
+            copy_value(sp, bufsize, to_remove);
         return to_remove;
     }
 
@@ -95,30 +273,128 @@ element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize)
 {
     if (head && !list_empty(head)) {
         element_t *to_remove = list_last_entry(head, element_t, list);
+        track_remove(queue_of(head), true);
         list_del(&to_remove->list);
+        queue_of(head)->size--;
 
-        if (sp) {
-            strncpy(sp, to_remove->value, bufsize - 1);
-            sp[bufsize - 1] = '\0';
-        }
+        if (sp)
+            copy_value(sp, bufsize, to_remove);
         return to_remove;
     }
 
     return NULL;
 }
 
+/* Return the @i-th node of a queue of @size elements, counting from 1, or
+ * @head itself for i = 0. The walk starts from whichever end is closer.
+ */
+static struct list_head *node_at(struct list_head *head, int size, int i)
+{
+    struct list_head *node = head;
+    if (i <= size / 2) {
+        while (i--)
+            node = node->next;
+    } else {
+        for (i = size - i + 1; i; i--)
+            node = node->prev;
+    }
+    return node;
+}
+
+/* Remove up to n elements from head of queue */
+int q_remove_head_n(struct list_head *head,
+                    int n,
+                    struct list_head *out,
+                    char *sp,
+                    size_t bufsize)
+{
+    if (!head || !out || n <= 0)
+        return 0;
+
+    queue_t *q = queue_of(head);
+    if (n >= q->size) {
+        n = q->size;
+        list_splice_init(head, out);
+    } else {
+        list_cut_position(out, head, node_at(head, q->size, n));
+    }
+    q->size -= n;
+    order_changed(q);
+    pack_strings(out, sp, bufsize);
+    return n;
+}
+
+/* Remove up to n elements from tail of queue */
+int q_remove_tail_n(struct list_head *head,
+                    int n,
+                    struct list_head *out,
+                    char *sp,
+                    size_t bufsize)
+{
+    if (!head || !out || n <= 0)
+        return 0;
+
+    queue_t *q = queue_of(head);
+    if (n >= q->size) {
+        n = q->size;
+        list_splice_init(head, out);
+    } else {
+        /* Cut off the part which stays, then move the rest over */
+        LIST_HEAD(keep);
+        list_cut_position(&keep, head, node_at(head, q->size, q->size - n));
+        list_splice_init(head, out);
+        list_splice(&keep, head);
+    }
+    q->size -= n;
+    order_changed(q);
+    pack_strings(out, sp, bufsize);
+    return n;
+}
+
 /* Return number of elements in queue */
 int q_size(struct list_head *head)
 {
-    if (!head || list_empty(head))
+    if (!head)
         return 0;
 
-    int count = 0;
-    struct list_head *temp;
-    list_for_each (temp, head)
-        count++;
+    return queue_of(head)->size;
+}
 
-    return count;
+/* The element the list node in @it stands for, NULL past either end */
+static inline element_t *iter_entry(const q_iter_t *it)
+{
+    struct list_head *node = it->pos;
+    return node != it->head ? list_entry(node, element_t, list) : NULL;
+}
+
+/* Start a walk at the head of queue */
+element_t *q_first(struct list_head *head, q_iter_t *it)
+{
+    it->head = head;
+    it->pos = head ? head->next : NULL;
+    return iter_entry(it);
+}
+
+/* Start a walk at the tail of queue */
+element_t *q_last(struct list_head *head, q_iter_t *it)
+{
+    it->head = head;
+    it->pos = head ? head->prev : NULL;
+    return iter_entry(it);
+}
+
+/* Move to the next element */
+element_t *q_next(q_iter_t *it)
+{
+    it->pos = ((struct list_head *) it->pos)->next;
+    return iter_entry(it);
+}
+
+/* Move to the previous element */
+element_t *q_prev(q_iter_t *it)
+{
+    it->pos = ((struct list_head *) it->pos)->prev;
+    return iter_entry(it);
 }
 
 /* Delete the middle node in queue */
@@ -128,25 +404,83 @@ bool q_delete_mid(struct list_head *head)
         return false;
     }
 
-    struct list_head *slow = head->next;
-    struct list_head *fast = head->next;
+    queue_t *q = queue_of(head);
+    int i = (q->size - 1) / 2;
+    struct list_head *mid = q->mid;
+    if (q->indexed)
+        mid = skip_delete(&q->index, i);
+    else if (!mid)
+        mid = node_at(head, q->size, i + 1);
 
-    while (fast != head && fast->next != head) {
-        slow = slow->next;
-        fast = fast->next->next;
-    }
+    /* The middle of the remaining nodes is a neighbour of the deleted one */
+    if (q->size == 1)
+        q->mid = NULL;
+    else
+        q->mid = q->size & 1 ? mid->prev : mid->next;
 
-    if (fast == head) {
-        slow = slow->prev;
-    }
+    element_t *middle_element = list_entry(mid, element_t, list);
+
+    list_del(mid);
+    q->size--;
+
+    q_release_element(middle_element);
+
+    return true;
+}
+
+/* Return the element at position i */
+element_t *q_at(struct list_head *head, int i)
+{
+    if (!head || i < 0 || i >= queue_of(head)->size)
+        return NULL;
+
+    queue_t *q = queue_of(head);
+    struct list_head *node = index_ready(q) ? skip_at(&q->index, i)
+                                            : node_at(head, q->size, i + 1);
+    return list_entry(node, element_t, list);
+}
+
+/* Insert an element at position i */
+bool q_insert_at(struct list_head *head, int i, char *s)
+{
+    if (!head || i < 0 || i > queue_of(head)->size)
+        return false;
 
-    element_t *middle_element = list_entry(slow, element_t, list);
+    queue_t *q = queue_of(head);
+    element_t *e = element_new(&q->arena, s);
+    if (!e)
+        return false;
 
-    list_del(slow);
+    /* The new element goes in front of the one now at position i */
+    struct list_head *next;
+    if (i == q->size)
+        next = head;
+    else if (index_ready(q))
+        next = skip_at(&q->index, i);
+    else
+        next = node_at(head, q->size, i + 1);
+    list_add_tail(&e->list, next);
+
+    if (q->indexed && !skip_insert(&q->index, &q->arena, i, &e->list))
+        q->indexed = false;
+    q->mid = NULL;
+    q->size++;
+    return true;
+}
 
-    free(middle_element->value);
-    free(middle_element);
+/* Delete the element at position i */
+bool q_delete_at(struct list_head *head, int i)
+{
+    if (!head || i < 0 || i >= queue_of(head)->size)
+        return false;
 
+    queue_t *q = queue_of(head);
+    struct list_head *node = index_ready(q) ? skip_delete(&q->index, i)
+                                            : node_at(head, q->size, i + 1);
+    list_del(node);
+    q->mid = NULL;
+    q->size--;
+    q_release_element(list_entry(node, element_t, list));
     return true;
 }
 
@@ -157,6 +491,7 @@ bool q_delete_dup(struct list_head *head)
         return false;
     }
 
+    order_changed(queue_of(head));
     struct list_head *current, *safe;
     element_t *entry, *next_entry;
     bool mark_del = false;
@@ -167,6 +502,7 @@ bool q_delete_dup(struct list_head *head)
                 entry = list_entry(current, element_t, list);
                 list_del(current);
                 q_release_element(entry);
+                queue_of(head)->size--;
             }
             break;
         }
@@ -174,13 +510,15 @@ bool q_delete_dup(struct list_head *head)
         entry = list_entry(current, element_t, list);
         next_entry = list_entry(current->next, element_t, list);
 
-        if (!strcmp(entry->value, next_entry->value)) {
+        if (!element_cmp(entry, next_entry)) {
             list_del(current);
             q_release_element(entry);
+            queue_of(head)->size--;
             mark_del = true;
         } else if (mark_del) {
             list_del(current);
             q_release_element(entry);
+            queue_of(head)->size--;
             mark_del = false;
         }
     }
@@ -188,26 +526,84 @@ bool q_delete_dup(struct list_head *head)
     return true;
 }
 
-/* Swap every two adjacent nodes */
-void q_swap(struct list_head *head)
+/* Delete all nodes whose string appears more than once, sorted or not */
+bool q_delete_dup_unsorted(struct list_head *head)
 {
-    if (!head || list_empty(head) || list_is_singular(head))
-        return;
+    if (!head || list_empty(head))
+        return false;
 
-    struct list_head *node = head->next;
-    while (node != head && node->next != head) {
-        struct list_head *nextNode = node->next;
+    dup_table_t t;
+    if (!dup_table_build(&t, head))
+        return false;
+
+    /* The table points into the queue, release nothing until it is gone */
+    order_changed(queue_of(head));
+    LIST_HEAD(doomed);
+    element_t *entry, *safe;
+    list_for_each_entry_safe (entry, safe, head, list) {
+        if (dup_table_repeated(&t, entry)) {
+            list_move_tail(&entry->list, &doomed);
+            queue_of(head)->size--;
+        }
+    }
+    dup_table_free(&t);
 
-        list_del(node);
-        list_del(nextNode);
+    list_for_each_entry_safe (entry, safe, &doomed, list)
+        q_release_element(entry);
+    return true;
+}
 
-        list_add(nextNode, node->prev);
-        list_add(node, nextNode);
+/* Reverse the nodes of @head in groups of @k in a single forward pass.
+ *
+ * The links of each node are swapped as soon as it is visited, then the two
+ * ends of the group are stitched to its neighbours. A trailing group shorter
+ * than @k is swapped back, so it costs at most k - 1 extra node visits and
+ * the length of the queue never has to be known in advance.
+ */
+static void reverse_groups(struct list_head *head, int k)
+{
+    struct list_head *prev = head, *node = head->next;
+
+    while (node != head) {
+        struct list_head *first = node, *last, *tmp;
+        int n = 0;
+
+        do {
+            last = node;
+            node = node->next;
+            tmp = last->next;
+            last->next = last->prev;
+            last->prev = tmp;
+        } while (++n < k && node != head);
+
+        if (n < k) {
+            /* prev now holds the original next pointer of each node */
+            for (node = first; node != head; node = tmp) {
+                tmp = node->prev;
+                node->prev = node->next;
+                node->next = tmp;
+            }
+            return;
+        }
 
-        node = node->next;
+        first->next = node;
+        node->prev = first;
+        last->prev = prev;
+        prev->next = last;
+        prev = first;
     }
 }
 
+/* Swap every two adjacent nodes */
+void q_swap(struct list_head *head)
+{
+    if (!head || list_empty(head) || list_is_singular(head))
+        return;
+
+    order_changed(queue_of(head));
+    reverse_groups(head, 2);
+}
+
 /* Reverse elements in queue */
 void q_reverse(struct list_head *head)
 {
@@ -218,6 +614,7 @@ void q_reverse(struct list_head *head)
     struct list_head *current = head;
     struct list_head *temp = NULL;
 
+    order_changed(queue_of(head));
     do {
         temp = current->next;
         current->next = current->prev;
@@ -233,163 +630,83 @@ void q_reverseK(struct list_head *head, int k)
     if (!head || list_empty(head) || k <= 1)
         return;
 
-    int len = 0;
-    struct list_head *current = head->next;
-    len = q_size(head);
-
-    struct list_head partition, *temp_head = head, *tail;
-    INIT_LIST_HEAD(&partition);
-
-    for (int i = 0; i < (len / k); i++) {
-        current = temp_head->next;
-        for (int j = 0; j < k; j++) {
-            tail = current;
-            current = current->next;
-        }
-        list_cut_position(&partition, temp_head, tail);
-        q_reverse(&partition);
-        list_splice_init(&partition, temp_head);
-        temp_head = current->prev;
-    }
-    return;
-    // https://leetcode.com/problems/reverse-nodes-in-k-group/
+    order_changed(queue_of(head));
+    reverse_groups(head, k);
 }
 
-void merge(struct list_head *l_head,
-           struct list_head *r_head,
-           struct list_head *head)
-{
-    struct list_head temp_list;
-    INIT_LIST_HEAD(&temp_list);
-
-    while (!list_empty(l_head) || !list_empty(r_head)) {
-        struct list_head *chosen;
-
-        if (list_empty(l_head)) {
-            chosen = r_head;
-        } else if (list_empty(r_head)) {
-            chosen = l_head;
-        } else {
-            element_t *l_entry = list_entry(l_head->next, element_t, list);
-            element_t *r_entry = list_entry(r_head->next, element_t, list);
-            chosen =
-                (strcmp(l_entry->value, r_entry->value) <= 0) ? l_head : r_head;
-        }
-
-        list_move_tail(chosen->next, &temp_list);
-    }
-
-    list_splice_tail_init(&temp_list, head);
-}
-void merge_sort_recursive(struct list_head *head, int length)
+/* Hang the null-terminated list starting at @first back onto @head, restoring
+ * the prev links and the circular structure in one pass.
+ */
+static void relink(struct list_head *head, struct list_head *first)
 {
-    if (length <= 1)
-        return;
-
-    int mid = length / 2;
-    struct list_head left, right;
-    INIT_LIST_HEAD(&left);
-    INIT_LIST_HEAD(&right);
-
-    struct list_head *current = head->next;
-    for (int i = 0; i < mid; i++) {
-        struct list_head *next = current->next;
-        list_move_tail(current, &left);
-        current = next;
+    struct list_head *prev = head, *node;
+    for (node = first; node; node = node->next) {
+        prev->next = node;
+        node->prev = prev;
+        prev = node;
     }
-    list_splice_tail_init(head, &right);
-
-    merge_sort_recursive(&left, mid);
-    merge_sort_recursive(&right, length - mid);
-
-    INIT_LIST_HEAD(head);
-    merge(&left, &right, head);
+    prev->next = head;
+    head->prev = prev;
 }
 
-void merge_sort(struct list_head *head)
+/* Sort the queue with the algorithm selected by sort_algo. The list is
+ * treated as singly linked through @next while sorting, and the @prev
+ * pointers are rebuilt in one pass at the end.
+ */
+void q_sort(struct list_head *head, bool descend)
 {
     if (!head || list_empty(head) || list_is_singular(head))
         return;
 
-    int length = 0;
-    struct list_head *pos;
-    list_for_each (pos, head) {
-        length++;
-    }
+    order_changed(queue_of(head));
 
-    merge_sort_recursive(head, length);
+    /* Break the circle so that the last node terminates the walk */
+    head->prev->next = NULL;
+    relink(head, sort_list(head->next, q_size(head), descend));
 }
 
-void q_sort(struct list_head *head, bool descend)
-{
-    merge_sort(head);
-    if (descend) {
-        q_reverse(head);
-    }
-}
-
-
-/* Remove every node which has a node with a strictly less value anywhere to
- * the right side of it */
-int q_ascend(struct list_head *head)
+/* Remove every node which has a node strictly in front of it, in the given
+ * order, anywhere to its right. A single pass from the tail keeps track of
+ * the smallest (or largest) value seen so far, which is the last node kept.
+ */
+static int q_keep_monotonic(struct list_head *head, bool descend)
 {
     if (!head || list_empty(head)) {
         return 0;
     }
 
-    struct list_head *current, *tmp, *next;
-
-    list_for_each_safe (current, tmp, head) {
-        char *current_value = list_entry(current, element_t, list)->value;
-        bool has_smaller_right = false;
+    struct list_head *kept = head->prev, *node = kept->prev, *prev;
 
-        for (next = current->next; next != head; next = next->next) {
-            char *next_value = list_entry(next, element_t, list)->value;
-            if (strcmp(current_value, next_value) > 0) {
-                has_smaller_right = true;
-                break;
-            }
-        }
+    order_changed(queue_of(head));
+    for (; node != head; node = prev) {
+        prev = node->prev;
+        element_t *entry = list_entry(node, element_t, list);
+        int cmp = element_cmp(entry, list_entry(kept, element_t, list));
 
-        if (has_smaller_right) {
-            list_del(current);
-            q_release_element(list_entry(current, element_t, list));
+        if (descend ? cmp < 0 : cmp > 0) {
+            list_del(node);
+            q_release_element(entry);
+            queue_of(head)->size--;
+        } else {
+            kept = node;
         }
     }
 
     return q_size(head);
 }
 
+/* Remove every node which has a node with a strictly less value anywhere to
+ * the right side of it */
+int q_ascend(struct list_head *head)
+{
+    return q_keep_monotonic(head, false);
+}
+
 /* Remove every node which has a node with a strictly greater value anywhere to
  * the right side of it */
 int q_descend(struct list_head *head)
 {
-    if (!head || list_empty(head)) {
-        return 0;
-    }
-
-    struct list_head *current, *tmp, *next;
-
-    list_for_each_safe (current, tmp, head) {
-        char *current_value = list_entry(current, element_t, list)->value;
-        bool has_greater_right = false;
-
-        for (next = current->next; next != head; next = next->next) {
-            char *next_value = list_entry(next, element_t, list)->value;
-            if (strcmp(current_value, next_value) < 0) {
-                has_greater_right = true;
-                break;
-            }
-        }
-
-        if (has_greater_right) {
-            list_del(current);
-            element_t *to_remove_element = list_entry(current, element_t, list);
-            q_release_element(to_remove_element);
-        }
-    }
-
-    return q_size(head);
+    return q_keep_monotonic(head, true);
 }
 
 /* Merge all the queues into one sorted queue, which is in
@@ -401,23 +718,54 @@ int q_merge(struct list_head *head, bool descend)
     }
 
     queue_contex_t *base_queue = list_first_entry(head, queue_contex_t, chain);
+    if (!base_queue->q)
+        return 0;
     if (list_is_singular(head)) {
-        return base_queue->size;
+        return q_size(base_queue->q);
     }
 
-    queue_contex_t *queue_to_merge;
-    struct list_head *current, *next;
+    struct list_head *lists[MERGE_MAX_WAYS];
+    queue_t *base = queue_of(base_queue->q);
+    struct list_head *current = base_queue->chain.next;
+
+    while (current != head) {
+        int n = 0;
+
+        if (!list_empty(&base->head)) {
+            base->head.prev->next = NULL;
+            lists[n++] = base->head.next;
+        }
+
+        for (; n < MERGE_MAX_WAYS && current != head; current = current->next) {
+            queue_contex_t *ctx = list_entry(current, queue_contex_t, chain);
+            if (!ctx->q)
+                continue;
 
-    list_for_each_safe (current, next, head) {
-        if (current == &base_queue->chain) {
-            continue;
+            queue_t *q = queue_of(ctx->q);
+            if (!list_empty(&q->head)) {
+                q->head.prev->next = NULL;
+                lists[n++] = q->head.next;
+            }
+            INIT_LIST_HEAD(&q->head);
+            arena_adopt(&base->arena, &q->arena);
+            base->size += q->size;
+            q->size = 0;
+            order_changed(q);
+            /* Its towers moved along with the chunks, leave them to @base */
+            skip_init(&q->index);
         }
-        queue_to_merge = list_entry(current, queue_contex_t, chain);
-        list_splice_tail_init(queue_to_merge->q, base_queue->q);
-        base_queue->size += queue_to_merge->size;
+
+        if (n)
+            relink(&base->head, merge_lists(lists, n, descend));
     }
+    order_changed(base);
 
-    q_sort(base_queue->q, descend);
-    return base_queue->size;
+    base_queue->size = base->size;
+    return base->size;
 }
 
+/* Move the pooled strings into a single block, in queue order */
+bool q_compact(struct list_head *head)
+{
+    return head && pool_compact(&queue_of(head)->arena, head);
+}
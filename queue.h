@@ -5,24 +5,49 @@
  * operations.
  *
  * It uses a circular doubly-linked list to represent the set of queue elements
+ * by default. Building with 'make QUEUE_BACKEND=unrolled' selects an unrolled
+ * list instead, which keeps pointers to the elements in arrays linked
+ * together, and 'make QUEUE_BACKEND=ring' a ring buffer of pointers to the
+ * elements. Callers work the same way with any of them, walking the queue
+ * through q_first() and friends.
  */
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
+#include "arena.h"
 #include "harness.h"
+#include "intern.h"
 #include "list.h"
 
 /**
  * element_t - Linked list element
  * @value: pointer to array holding string
  * @list: node of a doubly-linked list
- *
- * @value needs to be explicitly allocated and freed
+ * @key: the first 8 bytes of the string as a big-endian word, zero padded
+ * @chunk: arena chunk the element was carved from
+ * @len: length of the string, not counting the null terminator
+ * @pooled: whether the string lives in the string pool of the queue
+ * @buf: storage for the string, allocated together with the element
+ *
+ * The element and its string live in a single block: @value points into
+ * @buf, so releasing the element releases the string as well. Interned
+ * elements have an empty @buf instead, and @value holds a reference to the
+ * copy shared through the intern table. So do pooled elements, whose @value
+ * points into the string pool of the arena they were carved from. Comparing
+ * @key of two elements orders them like strcmp() on their first 8 bytes,
+ * which settles most comparisons without touching the strings.
  */
 typedef struct {
     char *value;
     struct list_head list;
+    uint64_t key;
+    arena_chunk_t *chunk;
+    uint32_t len;
+    bool pooled;
+    char buf[];
 } element_t;
 
 /**
@@ -51,9 +76,50 @@ struct list_head *q_new();
 /**
  * q_free() - Free all storage used by queue, no effect if header is NULL
  * @head: header of queue
+ *
+ * Elements are carved from an arena owned by the queue, which is released in
+ * bulk. Elements removed from the queue must be released before this call.
  */
 void q_free(struct list_head *head);
 
+/* Store new strings in the shared intern table rather than in the element,
+ * off by default. Elements keep the way they were created when it changes.
+ */
+extern int intern_mode;
+
+/* Store new strings back to back in a string pool of the queue rather than
+ * in the element, off by default. Intern mode takes precedence, and
+ * elements keep the way they were created when either changes.
+ */
+extern int pool_mode;
+
+/**
+ * q_compact() - Move the pooled strings of queue into a single block
+ * @head: header of queue
+ *
+ * The strings are laid out in the order of the queue, so walking a sorted
+ * queue scans them sequentially, and the space of released strings is
+ * recovered. Strings stored in the elements or interned are left alone.
+ * Elements removed from the queue must be released before this call.
+ *
+ * Return: true for success, false for allocation failed or queue is NULL
+ */
+bool q_compact(struct list_head *head);
+
+/**
+ * q_reserve() - Make room for a number of elements ahead of time
+ * @head: header of queue
+ * @n: number of elements the queue should be able to hold
+ *
+ * The ring backend stores elements in an array, which grows as needed. This
+ * grows it to hold @n elements at once, so that no memory has to be
+ * allocated for them later, e.g. by q_merge(). The other backends do not
+ * need memory ahead of time and only check @head.
+ *
+ * Return: true for success, false for allocation failed or queue is NULL
+ */
+bool q_reserve(struct list_head *head, int n);
+
 /**
  * q_insert_head() - Insert an element in the head
  * @head: header of queue
@@ -78,6 +144,34 @@ bool q_insert_head(struct list_head *head, char *s);
  */
 bool q_insert_tail(struct list_head *head, char *s);
 
+/**
+ * q_insert_head_bulk() - Insert an array of strings at the head
+ * @head: header of queue
+ * @s: strings would be inserted
+ * @n: number of strings in @s
+ *
+ * Equivalent to calling q_insert_head() on each string in turn, so @s[n - 1]
+ * ends up first. The elements are allocated together and spliced in at once.
+ * Either all of the strings are inserted or none of them is.
+ *
+ * Return: true for success, false for allocation failed or queue is NULL
+ */
+bool q_insert_head_bulk(struct list_head *head, char *s[], int n);
+
+/**
+ * q_insert_tail_bulk() - Insert an array of strings at the tail
+ * @head: header of queue
+ * @s: strings would be inserted
+ * @n: number of strings in @s
+ *
+ * Equivalent to calling q_insert_tail() on each string in turn. The elements
+ * are allocated together and spliced in at once. Either all of the strings
+ * are inserted or none of them is.
+ *
+ * Return: true for success, false for allocation failed or queue is NULL
+ */
+bool q_insert_tail_bulk(struct list_head *head, char *s[], int n);
+
 /**
  * q_remove_head() - Remove the element from head of queue
  * @head: header of queue
@@ -108,6 +202,51 @@ element_t *q_remove_head(struct list_head *head, char *sp, size_t bufsize);
  */
 element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize);
 
+/**
+ * q_remove_head_n() - Remove up to @n elements from head of queue at once
+ * @head: header of queue
+ * @n: number of elements to remove
+ * @out: empty list receiving the removed elements
+ * @sp: buffer receiving the removed strings, may be NULL
+ * @bufsize: size of @sp
+ *
+ * The removed elements are moved to @out as one detached run, in the order
+ * they had in the queue. Like q_remove_head(), nothing is freed: each element
+ * in @out must be released by the caller.
+ *
+ * If sp is non-NULL, the removed strings are copied into it back to back in
+ * the same order, each followed by a null terminator, and the whole list is
+ * ended by an empty string. A string which does not fit is left out along
+ * with all the strings after it.
+ *
+ * Return: the number of elements removed, zero if queue is NULL or empty
+ */
+int q_remove_head_n(struct list_head *head,
+                    int n,
+                    struct list_head *out,
+                    char *sp,
+                    size_t bufsize);
+
+/**
+ * q_remove_tail_n() - Remove up to @n elements from tail of queue at once
+ * @head: header of queue
+ * @n: number of elements to remove
+ * @out: empty list receiving the removed elements
+ * @sp: buffer receiving the removed strings, may be NULL
+ * @bufsize: size of @sp
+ *
+ * Works like q_remove_head_n() on the last @n elements. They keep the order
+ * they had in the queue, so the element q_remove_tail() would have returned
+ * first ends up last in @out.
+ *
+ * Return: the number of elements removed, zero if queue is NULL or empty
+ */
+int q_remove_tail_n(struct list_head *head,
+                    int n,
+                    struct list_head *out,
+                    char *sp,
+                    size_t bufsize);
+
 /**
  * q_release_element() - Release the element
  * @e: element would be released
@@ -116,8 +255,17 @@ element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize);
  */
 static inline void q_release_element(element_t *e)
 {
-    test_free(e->value);
-    test_free(e);
+    if (e->pooled) {
+        arena_strfree(e->chunk->arena, e->len);
+        arena_free(e->chunk, e, sizeof(element_t));
+        return;
+    }
+    if (e->value != e->buf) {
+        intern_put(e->value);
+        arena_free(e->chunk, e, sizeof(element_t));
+        return;
+    }
+    arena_free(e->chunk, e, sizeof(element_t) + e->len + 1);
 }
 
 /**
@@ -128,6 +276,57 @@ static inline void q_release_element(element_t *e)
  */
 int q_size(struct list_head *head);
 
+/**
+ * q_iter_t - Position of an element in a queue, see q_first()
+ * @head: header of the queue
+ * @pos: position of the current element, as tracked by the queue backend
+ * @slot: position of the current element, as tracked by the queue backend
+ */
+typedef struct {
+    struct list_head *head;
+    void *pos;
+    int slot;
+} q_iter_t;
+
+/**
+ * q_first() - Start a walk over the elements at the head of queue
+ * @head: header of queue
+ * @it: iterator set to the first element
+ *
+ * Walks go through q_first() or q_last() and then q_next() or q_prev(),
+ * rather than through the list nodes of the elements, since the queue
+ * backend decides how elements are linked together. The queue must not be
+ * modified during the walk.
+ *
+ * Return: the first element, %NULL if queue is NULL or empty
+ */
+element_t *q_first(struct list_head *head, q_iter_t *it);
+
+/**
+ * q_last() - Start a walk over the elements at the tail of queue
+ * @head: header of queue
+ * @it: iterator set to the last element
+ *
+ * Return: the last element, %NULL if queue is NULL or empty
+ */
+element_t *q_last(struct list_head *head, q_iter_t *it);
+
+/**
+ * q_next() - Move to the next element towards the tail
+ * @it: iterator on an element
+ *
+ * Return: the next element, %NULL if @it was on the last one
+ */
+element_t *q_next(q_iter_t *it);
+
+/**
+ * q_prev() - Move to the previous element towards the head
+ * @it: iterator on an element
+ *
+ * Return: the previous element, %NULL if @it was on the first one
+ */
+element_t *q_prev(q_iter_t *it);
+
 /**
  * q_delete_mid() - Delete the middle node in queue
  * @head: header of queue
@@ -143,6 +342,45 @@ int q_size(struct list_head *head);
  */
 bool q_delete_mid(struct list_head *head);
 
+/**
+ * q_at() - Get the element at a position
+ * @head: header of queue
+ * @i: position of the element, counting from 0 at the head
+ *
+ * With the list backend, the first positional access builds a skip index
+ * next to the list, which makes this and the other positional operations
+ * O(log n). The index is kept up to date by insertions and removals at either
+ * end and by q_delete_mid(), and rebuilt on demand after the elements are
+ * rearranged. The unrolled backend walks its chunks instead, 64 elements at
+ * a time, starting from the closest of both ends and the last position
+ * looked up.
+ *
+ * Return: the element, %NULL if queue is NULL or @i is out of range
+ */
+element_t *q_at(struct list_head *head, int i);
+
+/**
+ * q_insert_at() - Insert an element at a position
+ * @head: header of queue
+ * @i: position of the new element, from 0 to the size of the queue
+ * @s: string would be inserted
+ *
+ * The elements from position @i onwards move one position towards the tail.
+ *
+ * Return: true for success, false for allocation failed, queue is NULL or
+ * @i is out of range
+ */
+bool q_insert_at(struct list_head *head, int i, char *s);
+
+/**
+ * q_delete_at() - Delete the element at a position
+ * @head: header of queue
+ * @i: position of the element, counting from 0 at the head
+ *
+ * Return: true for success, false if queue is NULL or @i is out of range
+ */
+bool q_delete_at(struct list_head *head, int i);
+
 /**
  * q_delete_dup() - Delete all nodes that have duplicate string,
  *                  leaving only distinct strings from the original queue.
@@ -155,6 +393,20 @@ bool q_delete_mid(struct list_head *head);
  */
 bool q_delete_dup(struct list_head *head);
 
+/**
+ * q_delete_dup_unsorted() - Delete all nodes whose string appears more than
+ *                           once anywhere in the queue
+ * @head: header of queue
+ *
+ * Unlike q_delete_dup(), the queue need not be sorted: the strings are
+ * counted in an open-addressing hash table first, so this runs in O(n)
+ * expected time. The survivors keep their relative order.
+ *
+ * Return: true for success, false if list is NULL or empty, or if there was
+ * no memory for the table.
+ */
+bool q_delete_dup_unsorted(struct list_head *head);
+
 /**
  * q_swap() - Swap every two adjacent nodes
  * @head: header of queue
@@ -190,6 +442,31 @@ void q_reverse(struct list_head *head);
  */
 void q_reverseK(struct list_head *head, int k);
 
+/* Sorting algorithms q_sort() can use */
+enum {
+    SORT_MERGE, /* Run-adaptive merge sort */
+    SORT_RADIX, /* MSD radix sort, merge sort for short sublists */
+};
+
+/* The algorithm used by q_sort(), SORT_MERGE by default */
+extern int sort_algo;
+
+/* Maximum number of threads q_sort() can use */
+#define SORT_MAX_THREADS 64
+
+/**
+ * sort_set_threads() - Set the number of threads q_sort() uses
+ * @n: number of threads, the calling one included, 1 to sort serially
+ *
+ * Long queues are split into one segment per thread, sorted and merged in
+ * parallel; short ones are still sorted serially. The worker threads are
+ * started here, not when sorting, so q_sort() still allocates nothing.
+ *
+ * Return: the number of threads q_sort() will use, fewer than @n if @n is
+ * out of range or some threads could not be started
+ */
+int sort_set_threads(int n);
+
 /**
  * q_sort() - Sort elements of queue in ascending/descending order
  * @head: header of queue
@@ -239,7 +516,8 @@ int q_descend(struct list_head *head);
  * This function merge the second to the last queues in the chain into the first
  * queue. The queues are guaranteed to be sorted before this function is called.
  * No effect if there is only one queue in the chain. Allocation is disallowed
- * in this function. There is no need to free the 'qcontext_t' and its member
+ * in this function, callers make room for the merged queue beforehand with
+ * q_reserve() on the first queue. There is no need to free the 'qcontext_t' and its member
  * 'q' since they will be released externally. However, q_merge() is responsible
  * for making the queues to be NULL-queue, except the first one.
  *
@@ -0,0 +1,741 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "element.h"
+#include "queue.h"
+#include "sort.h"
+
+/* A growable ring buffer of element pointers. Both ends take O(1) amortized
+ * time, positions are found by index, and the operations rearranging
+ * elements work on the array in place. The @list member of the elements is
+ * not used while they are in the queue; it only links them in the lists
+ * handed out by q_remove_head_n() and the like, and while merging.
+ *
+ * Deleting or inserting at a position would move up to half of the
+ * elements. Instead, the buffer may have a gap of unused slots in front of
+ * some position: moving it costs the distance it moves, so a series of
+ * positional operations around the same place, like q_delete_mid() does,
+ * takes O(1) each. Operations on the whole queue close the gap first.
+ */
+
+/* Capacity of the buffer when the first element is inserted */
+#define RING_MIN_CAPACITY 16
+
+/* The queue header handed out by q_new(). The list head is never linked to
+ * anything and stays empty. Position i of the queue lives in slot
+ * (first + i) & mask of @buf, or gap_len slots further from position
+ * @gap_pos onwards; the gap is either empty or strictly inside the queue.
+ */
+typedef struct {
+    struct list_head head;
+    int size;
+    int first;
+    int mask;
+    int gap_pos, gap_len;
+    element_t **buf;
+    arena_t arena;
+} queue_t;
+
+static inline queue_t *queue_of(struct list_head *head)
+{
+    return container_of(head, queue_t, head);
+}
+
+static inline int capacity(const queue_t *q)
+{
+    return q->buf ? q->mask + 1 : 0;
+}
+
+/* The slot holding position @i */
+static inline element_t **slot(queue_t *q, int i)
+{
+    if (i >= q->gap_pos)
+        i += q->gap_len;
+    return &q->buf[(q->first + i) & q->mask];
+}
+
+/* Move the gap in front of position @i, shifting the elements in between */
+static void gap_move(queue_t *q, int i)
+{
+    if (q->gap_len) {
+        for (int k = q->gap_pos; k < i; k++)
+            q->buf[(q->first + k) & q->mask] =
+                q->buf[(q->first + k + q->gap_len) & q->mask];
+        for (int k = q->gap_pos; k-- > i;)
+            q->buf[(q->first + k + q->gap_len) & q->mask] =
+                q->buf[(q->first + k) & q->mask];
+    }
+    q->gap_pos = i;
+}
+
+/* Keep the gap strictly inside the queue. A gap at either end is just part
+ * of the free slots around the queue.
+ */
+static void gap_trim(queue_t *q)
+{
+    if (!q->gap_pos) {
+        q->first = (q->first + q->gap_len) & q->mask;
+        q->gap_len = 0;
+    } else if (q->gap_pos >= q->size) {
+        q->gap_len = 0;
+    }
+}
+
+/* Close the gap by moving the elements on its shorter side */
+static void gap_close(queue_t *q)
+{
+    if (!q->gap_len)
+        return;
+
+    gap_move(q, q->gap_pos < q->size - q->gap_pos ? 0 : q->size);
+    gap_trim(q);
+}
+
+/* Move the elements of @q to slots 0 to size - 1, and return the array */
+static element_t **linearize(queue_t *q)
+{
+    gap_close(q);
+    if (q->first + q->size > capacity(q)) {
+        /* Rotate the whole buffer, empty slots included, by three reversals */
+        element_t **buf = q->buf;
+        int n = capacity(q);
+        for (int i = 0, j = q->first - 1; i < j; i++, j--) {
+            element_t *e = buf[i];
+            buf[i] = buf[j];
+            buf[j] = e;
+        }
+        for (int i = q->first, j = n - 1; i < j; i++, j--) {
+            element_t *e = buf[i];
+            buf[i] = buf[j];
+            buf[j] = e;
+        }
+        for (int i = 0, j = n - 1; i < j; i++, j--) {
+            element_t *e = buf[i];
+            buf[i] = buf[j];
+            buf[j] = e;
+        }
+        q->first = 0;
+    }
+    return q->buf + q->first;
+}
+
+/* Make room for @n elements in @q, false if no memory. The buffer only grows
+ * if closing the gap does not free enough slots.
+ */
+static bool reserve(queue_t *q, int n)
+{
+    if (n + q->gap_len <= capacity(q))
+        return true;
+    if (n <= capacity(q)) {
+        gap_close(q);
+        return true;
+    }
+
+    int cap = capacity(q) ? capacity(q) : RING_MIN_CAPACITY;
+    while (cap < n)
+        cap <<= 1;
+    element_t **buf = malloc(sizeof(element_t *) * cap);
+    if (!buf)
+        return false;
+
+    for (int i = 0; i < q->size; i++)
+        buf[i] = *slot(q, i);
+    free(q->buf);
+    q->buf = buf;
+    q->mask = cap - 1;
+    q->first = 0;
+    q->gap_pos = q->gap_len = 0;
+    return true;
+}
+
+/* Add @e at one end of @q, false if the buffer could not grow */
+static bool push(queue_t *q, element_t *e, bool tail)
+{
+    if (!reserve(q, q->size + 1))
+        return false;
+
+    if (tail) {
+        q->buf[(q->first + q->size + q->gap_len) & q->mask] = e;
+    } else {
+        q->first = (q->first - 1) & q->mask;
+        q->buf[q->first] = e;
+        q->gap_pos++;
+    }
+    q->size++;
+    return true;
+}
+
+/* Take the element at one end of @q, which must not be empty */
+static element_t *pop(queue_t *q, bool tail)
+{
+    element_t *e;
+    q->size--;
+    if (tail) {
+        e = *slot(q, q->size);
+    } else {
+        e = q->buf[q->first];
+        q->first = (q->first + 1) & q->mask;
+        q->gap_pos--;
+    }
+    if (q->gap_len)
+        gap_trim(q);
+    return e;
+}
+
+/* Create an empty queue */
+struct list_head *q_new()
+{
+    queue_t *q = malloc(sizeof(queue_t));
+    if (!q)
+        return NULL;
+
+    INIT_LIST_HEAD(&q->head);
+    q->size = 0;
+    q->first = 0;
+    q->mask = 0;
+    q->gap_pos = q->gap_len = 0;
+    q->buf = NULL;
+    arena_init(&q->arena);
+    return &q->head;
+}
+
+/* Free all storage used by queue */
+void q_free(struct list_head *head)
+{
+    if (!head)
+        return;
+
+    /* Elements all live in the arena */
+    queue_t *q = queue_of(head);
+    if (intern_count()) {
+        for (int i = 0; i < q->size; i++) {
+            element_t *e = *slot(q, i);
+            if (element_interned(e))
+                intern_put(e->value);
+        }
+    }
+    arena_destroy(&q->arena);
+    free(q->buf);
+    free(q);
+}
+
+/* Make room for n elements in queue */
+bool q_reserve(struct list_head *head, int n)
+{
+    return head && reserve(queue_of(head), n);
+}
+
+/* Insert a copy of @s at one end of queue */
+static bool insert(struct list_head *head, char *s, bool tail)
+{
+    if (!head)
+        return false;
+
+    queue_t *q = queue_of(head);
+    element_t *e = element_new(&q->arena, s);
+    if (!e)
+        return false;
+
+    if (!push(q, e, tail)) {
+        q_release_element(e);
+        return false;
+    }
+    return true;
+}
+
+/* Insert an element at head of queue */
+bool q_insert_head(struct list_head *head, char *s)
+{
+    return insert(head, s, false);
+}
+
+/* Insert an element at tail of queue */
+bool q_insert_tail(struct list_head *head, char *s)
+{
+    return insert(head, s, true);
+}
+
+/* Insert copies of the @n strings in @s, growing the buffer once up front
+ * and undoing the whole call if one of them fails.
+ */
+static bool insert_bulk(struct list_head *head, char *s[], int n, bool tail)
+{
+    if (!head || n < 0 || (n && !s))
+        return false;
+
+    queue_t *q = queue_of(head);
+    if (!reserve(q, q->size + n))
+        return false;
+
+    for (int i = 0; i < n; i++) {
+        element_t *e = element_new(&q->arena, s[i]);
+        if (!e) {
+            while (i--)
+                q_release_element(pop(q, tail));
+            return false;
+        }
+        push(q, e, tail);
+    }
+    return true;
+}
+
+/* Insert an array of strings at head of queue */
+bool q_insert_head_bulk(struct list_head *head, char *s[], int n)
+{
+    return insert_bulk(head, s, n, false);
+}
+
+/* Insert an array of strings at tail of queue */
+bool q_insert_tail_bulk(struct list_head *head, char *s[], int n)
+{
+    return insert_bulk(head, s, n, true);
+}
+
+/* Remove the element at one end of queue */
+static element_t *remove_one(struct list_head *head,
+                             char *sp,
+                             size_t bufsize,
+                             bool tail)
+{
+    if (!head || !queue_of(head)->size)
+        return NULL;
+
+    element_t *e = pop(queue_of(head), tail);
+    if (sp)
+        copy_value(sp, bufsize, e);
+    return e;
+}
+
+/* Remove an element from head of queue */
+element_t *q_remove_head(struct list_head *head, char *sp, size_t bufsize)
+{
+    return remove_one(head, sp, bufsize, false);
+}
+
+/* Remove an element from tail of queue */
+element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize)
+{
+    return remove_one(head, sp, bufsize, true);
+}
+
+/* Remove up to @n elements at one end of queue into @out, in queue order */
+static int remove_n(struct list_head *head,
+                    int n,
+                    struct list_head *out,
+                    char *sp,
+                    size_t bufsize,
+                    bool tail)
+{
+    if (!head || !out || n <= 0)
+        return 0;
+
+    queue_t *q = queue_of(head);
+    if (n > q->size)
+        n = q->size;
+    for (int i = 0; i < n; i++) {
+        element_t *e = pop(q, tail);
+        if (tail)
+            list_add(&e->list, out);
+        else
+            list_add_tail(&e->list, out);
+    }
+    pack_strings(out, sp, bufsize);
+    return n;
+}
+
+/* Remove up to n elements from head of queue */
+int q_remove_head_n(struct list_head *head,
+                    int n,
+                    struct list_head *out,
+                    char *sp,
+                    size_t bufsize)
+{
+    return remove_n(head, n, out, sp, bufsize, false);
+}
+
+/* Remove up to n elements from tail of queue */
+int q_remove_tail_n(struct list_head *head,
+                    int n,
+                    struct list_head *out,
+                    char *sp,
+                    size_t bufsize)
+{
+    return remove_n(head, n, out, sp, bufsize, true);
+}
+
+/* Return number of elements in queue */
+int q_size(struct list_head *head)
+{
+    if (!head)
+        return 0;
+
+    return queue_of(head)->size;
+}
+
+/* The element at the position in @it, NULL past either end */
+static inline element_t *iter_entry(const q_iter_t *it)
+{
+    queue_t *q = it->pos;
+    return q && it->slot >= 0 && it->slot < q->size ? *slot(q, it->slot)
+                                                     : NULL;
+}
+
+/* Start a walk at the head of queue */
+element_t *q_first(struct list_head *head, q_iter_t *it)
+{
+    it->head = head;
+    it->pos = head ? queue_of(head) : NULL;
+    it->slot = 0;
+    return iter_entry(it);
+}
+
+/* Start a walk at the tail of queue */
+element_t *q_last(struct list_head *head, q_iter_t *it)
+{
+    it->head = head;
+    it->pos = head ? queue_of(head) : NULL;
+    it->slot = head ? queue_of(head)->size - 1 : 0;
+    return iter_entry(it);
+}
+
+/* Move to the next element */
+element_t *q_next(q_iter_t *it)
+{
+    it->slot++;
+    return iter_entry(it);
+}
+
+/* Move to the previous element */
+element_t *q_prev(q_iter_t *it)
+{
+    it->slot--;
+    return iter_entry(it);
+}
+
+/* Delete the middle node in queue */
+bool q_delete_mid(struct list_head *head)
+{
+    if (!head || !queue_of(head)->size)
+        return false;
+
+    return q_delete_at(head, (queue_of(head)->size - 1) / 2);
+}
+
+/* Return the element at position i */
+element_t *q_at(struct list_head *head, int i)
+{
+    if (!head || i < 0 || i >= queue_of(head)->size)
+        return NULL;
+
+    return *slot(queue_of(head), i);
+}
+
+/* Insert an element at position i */
+bool q_insert_at(struct list_head *head, int i, char *s)
+{
+    if (!head || i < 0 || i > queue_of(head)->size)
+        return false;
+
+    queue_t *q = queue_of(head);
+    if (!i || i == q->size)
+        return insert(head, s, i != 0);
+
+    element_t *e = element_new(&q->arena, s);
+    if (!e)
+        return false;
+
+    if (q->gap_len) {
+        /* Take the first slot of the gap, moved in front of position i */
+        gap_move(q, i);
+        q->buf[(q->first + i) & q->mask] = e;
+        q->gap_pos++;
+        q->gap_len--;
+    } else {
+        if (!reserve(q, q->size + 1)) {
+            q_release_element(e);
+            return false;
+        }
+        /* Open a one-slot gap from the free slots at the closer end */
+        if (i < q->size - i) {
+            q->first = (q->first - 1) & q->mask;
+            q->gap_pos = 0;
+            q->gap_len = 1;
+        } else {
+            q->gap_pos = q->size;
+            q->gap_len = 1;
+        }
+        gap_move(q, i);
+        q->buf[(q->first + i) & q->mask] = e;
+        q->gap_pos++;
+        q->gap_len--;
+    }
+    q->size++;
+    return true;
+}
+
+/* Delete the element at position i */
+bool q_delete_at(struct list_head *head, int i)
+{
+    if (!head || i < 0 || i >= queue_of(head)->size)
+        return false;
+
+    /* The slot of the element joins the gap, moved in front of it */
+    queue_t *q = queue_of(head);
+    gap_move(q, i);
+    element_t *e = *slot(q, i);
+    q->gap_len++;
+    q->size--;
+    gap_trim(q);
+    q_release_element(e);
+    return true;
+}
+
+/* Delete all nodes that have duplicate string */
+bool q_delete_dup(struct list_head *head)
+{
+    if (!head || !queue_of(head)->size)
+        return false;
+
+    /* Compact the survivors towards the head in a single pass */
+    queue_t *q = queue_of(head);
+    element_t **v = linearize(q);
+    int kept = 0;
+    bool dup = false;
+
+    for (int i = 0; i < q->size; i++) {
+        bool same = i + 1 < q->size && !element_cmp(v[i], v[i + 1]);
+        if (same || dup)
+            q_release_element(v[i]);
+        else
+            v[kept++] = v[i];
+        dup = same;
+    }
+    q->size = kept;
+    return true;
+}
+
+bool q_delete_dup_unsorted(struct list_head *head)
+{
+    if (!head || !queue_of(head)->size)
+        return false;
+
+    queue_t *q = queue_of(head);
+    dup_table_t t;
+    if (!dup_table_build(&t, head))
+        return false;
+
+    /* Swap the survivors towards the head, keeping their order. The table
+     * points into the queue, so the rest is released once it is gone.
+     */
+    element_t **v = linearize(q);
+    int kept = 0;
+    for (int i = 0; i < q->size; i++) {
+        if (dup_table_repeated(&t, v[i]))
+            continue;
+        element_t *e = v[kept];
+        v[kept++] = v[i];
+        v[i] = e;
+    }
+    dup_table_free(&t);
+
+    for (int i = kept; i < q->size; i++)
+        q_release_element(v[i]);
+    q->size = kept;
+    return true;
+}
+
+/* Swap every two adjacent nodes */
+void q_swap(struct list_head *head)
+{
+    q_reverseK(head, 2);
+}
+
+/* Reverse the elements of @v from @i to @j included */
+static inline void reverse_range(element_t **v, int i, int j)
+{
+    for (; i < j; i++, j--) {
+        element_t *e = v[i];
+        v[i] = v[j];
+        v[j] = e;
+    }
+}
+
+/* Reverse elements in queue */
+void q_reverse(struct list_head *head)
+{
+    if (!head || queue_of(head)->size < 2)
+        return;
+
+    queue_t *q = queue_of(head);
+    reverse_range(linearize(q), 0, q->size - 1);
+}
+
+/* Reverse the nodes of the list k at a time */
+void q_reverseK(struct list_head *head, int k)
+{
+    if (!head || queue_of(head)->size < 2 || k <= 1)
+        return;
+
+    queue_t *q = queue_of(head);
+    element_t **v = linearize(q);
+    for (int i = 0; i + k <= q->size; i += k)
+        reverse_range(v, i, i + k - 1);
+    // https://leetcode.com/problems/reverse-nodes-in-k-group/
+}
+
+/* Sort the queue with the algorithm selected by sort_algo, in place */
+void q_sort(struct list_head *head, bool descend)
+{
+    if (!head || queue_of(head)->size < 2)
+        return;
+
+    queue_t *q = queue_of(head);
+    sort_array(linearize(q), q->size, descend);
+}
+
+/* Remove every node which has a node strictly in front of it, in the given
+ * order, anywhere to its right. A single pass from the tail keeps track of
+ * the smallest (or largest) value seen so far, which is the last node kept,
+ * and compacts the survivors towards the tail.
+ */
+static int q_keep_monotonic(struct list_head *head, bool descend)
+{
+    if (!head || !queue_of(head)->size)
+        return 0;
+
+    queue_t *q = queue_of(head);
+    element_t **v = linearize(q);
+    int kept = q->size - 1;
+
+    for (int i = q->size - 2; i >= 0; i--) {
+        int cmp = element_cmp(v[i], v[kept]);
+        if (descend ? cmp < 0 : cmp > 0)
+            q_release_element(v[i]);
+        else
+            v[--kept] = v[i];
+    }
+    q->first += kept;
+    q->size -= kept;
+
+    return q->size;
+}
+
+/* Remove every node which has a node with a strictly less value anywhere to
+ * the right side of it */
+int q_ascend(struct list_head *head)
+{
+    return q_keep_monotonic(head, false);
+}
+
+/* Remove every node which has a node with a strictly greater value anywhere to
+ * the right side of it */
+int q_descend(struct list_head *head)
+{
+    return q_keep_monotonic(head, true);
+}
+
+/* Link the elements of @q through the @next pointer of their @list member,
+ * in queue order, return the first one and leave @q empty.
+ */
+static struct list_head *thread(queue_t *q)
+{
+    struct list_head *first = NULL, **tail = &first;
+    for (int i = 0; i < q->size; i++) {
+        *tail = &(*slot(q, i))->list;
+        tail = &(*tail)->next;
+    }
+    *tail = NULL;
+    q->size = 0;
+    q->first = 0;
+    q->gap_pos = q->gap_len = 0;
+    return first;
+}
+
+/* Merge all the queues into one sorted queue, which is in
+ * ascending/descending order */
+int q_merge(struct list_head *head, bool descend)
+{
+    if (!head || list_empty(head)) {
+        return 0;
+    }
+
+    queue_contex_t *base_queue = list_first_entry(head, queue_contex_t, chain);
+    if (!base_queue->q)
+        return 0;
+    if (list_is_singular(head)) {
+        return q_size(base_queue->q);
+    }
+
+    /* The merged elements must fit in the buffer of one of the queues. The
+     * largest one goes to @base, along with the elements in it, in exchange
+     * for its own. Callers are expected to have made room with q_reserve(),
+     * otherwise the buffer has to grow here.
+     */
+    queue_t *base = queue_of(base_queue->q), *largest = base;
+    int total = 0;
+    queue_contex_t *ctx;
+    list_for_each_entry (ctx, head, chain) {
+        if (!ctx->q)
+            continue;
+        queue_t *q = queue_of(ctx->q);
+        total += q->size;
+        if (capacity(q) > capacity(largest))
+            largest = q;
+    }
+    if (!reserve(largest, total))
+        return base->size;
+    if (largest != base) {
+        queue_t tmp = *base;
+        base->size = largest->size;
+        base->first = largest->first;
+        base->mask = largest->mask;
+        base->gap_pos = largest->gap_pos;
+        base->gap_len = largest->gap_len;
+        base->buf = largest->buf;
+        largest->size = tmp.size;
+        largest->first = tmp.first;
+        largest->mask = tmp.mask;
+        largest->gap_pos = tmp.gap_pos;
+        largest->gap_len = tmp.gap_len;
+        largest->buf = tmp.buf;
+    }
+
+    struct list_head *lists[MERGE_MAX_WAYS];
+    struct list_head *current = base_queue->chain.next;
+
+    while (current != head) {
+        int n = 0;
+
+        /* Even when empty, @base may have been left with an offset or a gap
+         * by earlier removals, which thread() clears before it is refilled.
+         */
+        struct list_head *merged = thread(base);
+        if (merged)
+            lists[n++] = merged;
+
+        for (; n < MERGE_MAX_WAYS && current != head; current = current->next) {
+            ctx = list_entry(current, queue_contex_t, chain);
+            if (!ctx->q)
+                continue;
+
+            queue_t *q = queue_of(ctx->q);
+            if (q->size)
+                lists[n++] = thread(q);
+            arena_adopt(&base->arena, &q->arena);
+        }
+
+        struct list_head *node = n ? merge_lists(lists, n, descend) : NULL;
+        for (; node; node = node->next)
+            base->buf[base->size++] = list_entry(node, element_t, list);
+    }
+
+    base_queue->size = base->size;
+    return base->size;
+}
+
+/* Move the pooled strings into a single block, in queue order */
+bool q_compact(struct list_head *head)
+{
+    return head && pool_compact(&queue_of(head)->arena, head);
+}
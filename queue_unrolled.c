@@ -0,0 +1,883 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "element.h"
+#include "queue.h"
+#include "sort.h"
+
+/* An unrolled linked list: rather than linking the elements themselves, the
+ * queue links chunks holding pointers to up to UNROLL_SLOTS consecutive
+ * elements. Walking the queue then reads the element pointers sequentially,
+ * and the elements they point to can be fetched in parallel, instead of
+ * chasing one pointer per element. The @list member of the elements is not
+ * used while they are in the queue; it only links them in the lists handed
+ * out by q_remove_head_n() and the like, and while sorting and merging.
+ */
+
+/* Number of element pointers a chunk holds */
+#define UNROLL_SLOTS 64
+
+/* Number of chunks carved from the arena at once */
+#define UNROLL_BATCH 8
+
+/**
+ * unroll_chunk_t - A run of consecutive elements
+ * @node: node in the list of chunks of the queue
+ * @begin: first occupied slot
+ * @end: slot following the last occupied one
+ * @slot: pointers to the elements, in queue order
+ *
+ * Chunks in the queue are never empty. Like the elements, chunks are carved
+ * from the arena of the queue and recycled within it: empty ones go to the
+ * spare list of the queue, and their memory comes back with the arena.
+ */
+typedef struct {
+    struct list_head node;
+    int begin, end;
+    element_t *slot[UNROLL_SLOTS];
+} unroll_chunk_t;
+
+/* The queue header handed out by q_new(). The list head links the chunks,
+ * so it stays circular and doubly linked like the one of the list backend.
+ * @finger is the chunk found by the last positional lookup and @finger_pos
+ * the position of its first element, see locate(); NULL when not known.
+ */
+typedef struct {
+    struct list_head head;
+    int size;
+    unroll_chunk_t *finger;
+    int finger_pos;
+    struct list_head spare;
+    arena_t arena;
+} queue_t;
+
+static inline queue_t *queue_of(struct list_head *head)
+{
+    return container_of(head, queue_t, head);
+}
+
+static inline unroll_chunk_t *chunk_of(struct list_head *node)
+{
+    return list_entry(node, unroll_chunk_t, node);
+}
+
+static inline int chunk_count(const unroll_chunk_t *c)
+{
+    return c->end - c->begin;
+}
+
+/* Get an empty chunk whose elements start at slot @at, NULL if no memory */
+static unroll_chunk_t *chunk_get(queue_t *q, int at)
+{
+    if (list_empty(&q->spare)) {
+        arena_chunk_t *chunk;
+        unroll_chunk_t *batch = arena_alloc_block(
+            &q->arena, UNROLL_BATCH * sizeof(unroll_chunk_t), &chunk);
+        if (!batch)
+            return NULL;
+        for (int i = 0; i < UNROLL_BATCH; i++)
+            list_add_tail(&batch[i].node, &q->spare);
+    }
+
+    unroll_chunk_t *c = chunk_of(q->spare.next);
+    list_del(&c->node);
+    c->begin = c->end = at;
+    return c;
+}
+
+/* Take the chunk @c, just emptied, out of the queue */
+static void chunk_put(queue_t *q, unroll_chunk_t *c)
+{
+    if (c == q->finger)
+        q->finger = NULL;
+    list_move(&c->node, &q->spare);
+}
+
+/* Move the elements of @b to the end of @a, which comes right before it and
+ * has room for them, and take @b out of the queue.
+ */
+static void chunk_join(queue_t *q, unroll_chunk_t *a, unroll_chunk_t *b)
+{
+    if (a->end + chunk_count(b) > UNROLL_SLOTS) {
+        memmove(a->slot, a->slot + a->begin,
+                chunk_count(a) * sizeof(element_t *));
+        a->end -= a->begin;
+        a->begin = 0;
+    }
+    memcpy(a->slot + a->end, b->slot + b->begin,
+           chunk_count(b) * sizeof(element_t *));
+    a->end += chunk_count(b);
+    b->begin = b->end;
+    chunk_put(q, b);
+}
+
+/* Add @e at one end of @q, false if no chunk could be allocated for it */
+static bool push(queue_t *q, element_t *e, bool tail)
+{
+    unroll_chunk_t *c = NULL;
+    if (!list_empty(&q->head))
+        c = chunk_of(tail ? q->head.prev : q->head.next);
+
+    if (!c || (tail ? c->end == UNROLL_SLOTS : !c->begin)) {
+        /* The first chunk starts in the middle so that both ends can grow */
+        int at = !c ? UNROLL_SLOTS / 2 : tail ? 0 : UNROLL_SLOTS;
+        if (!(c = chunk_get(q, at)))
+            return false;
+        if (tail)
+            list_add_tail(&c->node, &q->head);
+        else
+            list_add(&c->node, &q->head);
+    }
+
+    if (tail) {
+        c->slot[c->end++] = e;
+    } else {
+        c->slot[--c->begin] = e;
+        if (c != q->finger)
+            q->finger_pos++;
+    }
+    q->size++;
+    return true;
+}
+
+/* Take the element at one end of @q, which must not be empty */
+static element_t *pop(queue_t *q, bool tail)
+{
+    unroll_chunk_t *c = chunk_of(tail ? q->head.prev : q->head.next);
+    element_t *e = tail ? c->slot[--c->end] : c->slot[c->begin++];
+    if (!tail && c != q->finger)
+        q->finger_pos--;
+    if (c->begin == c->end)
+        chunk_put(q, c);
+    q->size--;
+    return e;
+}
+
+/* Find the element at position @i, counting from 0. Return its chunk and
+ * set *@j to its slot.
+ *
+ * The walk over the chunks starts from whichever is closest of the head, the
+ * tail and the finger left by the previous lookup. The finger stays valid
+ * through insertions and removals at either end and within its own chunk,
+ * so repeated lookups around the same position, like q_delete_mid() does,
+ * take constant time.
+ */
+static unroll_chunk_t *locate(queue_t *q, int i, int *j)
+{
+    unroll_chunk_t *c;
+    int at; /* position of the first element of @c */
+
+    int dist = i < q->size - i ? i : q->size - i;
+    if (q->finger && abs(i - q->finger_pos) < dist) {
+        c = q->finger;
+        at = q->finger_pos;
+    } else if (i < q->size / 2) {
+        c = chunk_of(q->head.next);
+        at = 0;
+    } else {
+        c = chunk_of(q->head.prev);
+        at = q->size - chunk_count(c);
+    }
+
+    while (i < at) {
+        c = chunk_of(c->node.prev);
+        at -= chunk_count(c);
+    }
+    while (i >= at + chunk_count(c)) {
+        at += chunk_count(c);
+        c = chunk_of(c->node.next);
+    }
+
+    q->finger = c;
+    q->finger_pos = at;
+    *j = c->begin + i - at;
+    return c;
+}
+
+/* Take the element in slot @j of @c, as found by locate(), out of the
+ * queue, closing the gap from the shorter side. A chunk left mostly empty is
+ * joined with a neighbour when they fit in one chunk together.
+ */
+static element_t *take(queue_t *q, unroll_chunk_t *c, int j)
+{
+    element_t *e = c->slot[j];
+
+    if (j - c->begin < c->end - j - 1) {
+        memmove(c->slot + c->begin + 1, c->slot + c->begin,
+                (j - c->begin) * sizeof(element_t *));
+        c->begin++;
+    } else {
+        memmove(c->slot + j, c->slot + j + 1,
+                (c->end - j - 1) * sizeof(element_t *));
+        c->end--;
+    }
+    q->size--;
+
+    if (c->begin == c->end) {
+        chunk_put(q, c);
+    } else if (chunk_count(c) < UNROLL_SLOTS / 4) {
+        unroll_chunk_t *next = chunk_of(c->node.next);
+        unroll_chunk_t *prev = chunk_of(c->node.prev);
+        if (c->node.next != &q->head &&
+            chunk_count(c) + chunk_count(next) <= UNROLL_SLOTS)
+            chunk_join(q, c, next);
+        else if (c->node.prev != &q->head &&
+                 chunk_count(prev) + chunk_count(c) <= UNROLL_SLOTS)
+            chunk_join(q, prev, c);
+    }
+    return e;
+}
+
+/* Squeeze out the slots a pass over the queue has set to NULL, keeping the
+ * remaining elements in order. Chunks left empty are taken out.
+ */
+static void sweep(queue_t *q)
+{
+    unroll_chunk_t *c, *safe;
+    q->finger = NULL;
+    list_for_each_entry_safe (c, safe, &q->head, node) {
+        int end = c->begin;
+        for (int j = c->begin; j < c->end; j++) {
+            if (c->slot[j])
+                c->slot[end++] = c->slot[j];
+        }
+        c->end = end;
+        if (c->begin == c->end)
+            chunk_put(q, c);
+    }
+}
+
+/* Link the elements of @q through the @next pointer of their @list member,
+ * in queue order, and return the first one.
+ */
+static struct list_head *thread(queue_t *q)
+{
+    struct list_head *first = NULL, **tail = &first;
+    unroll_chunk_t *c;
+    list_for_each_entry (c, &q->head, node) {
+        for (int j = c->begin; j < c->end; j++) {
+            *tail = &c->slot[j]->list;
+            tail = &(*tail)->next;
+        }
+    }
+    *tail = NULL;
+    return first;
+}
+
+/* Lay out the null-terminated list @first in the chunks of @pool, filling
+ * each one from its first slot, and append those chunks to @q. The chunks
+ * left over become spares, so nothing is allocated or freed. @pool must have
+ * room for every element of the list.
+ */
+static void refill(queue_t *q, struct list_head *pool, struct list_head *first)
+{
+    while (first) {
+        unroll_chunk_t *c = chunk_of(pool->next);
+        list_move_tail(&c->node, &q->head);
+        c->begin = c->end = 0;
+        for (; first && c->end < UNROLL_SLOTS; first = first->next)
+            c->slot[c->end++] = list_entry(first, element_t, list);
+    }
+    list_splice(pool, &q->spare);
+    q->finger = NULL;
+}
+
+/* Create an empty queue */
+struct list_head *q_new()
+{
+    queue_t *q = malloc(sizeof(queue_t));
+    if (!q)
+        return NULL;
+
+    INIT_LIST_HEAD(&q->head);
+    q->size = 0;
+    q->finger = NULL;
+    INIT_LIST_HEAD(&q->spare);
+    arena_init(&q->arena);
+    return &q->head;
+}
+
+/* Free all storage used by queue */
+void q_free(struct list_head *head)
+{
+    if (!head)
+        return;
+
+    /* Elements and chunks all live in the arena */
+    queue_t *q = queue_of(head);
+    if (intern_count()) {
+        unroll_chunk_t *c;
+        list_for_each_entry (c, head, node) {
+            for (int j = c->begin; j < c->end; j++) {
+                if (element_interned(c->slot[j]))
+                    intern_put(c->slot[j]->value);
+            }
+        }
+    }
+    arena_destroy(&q->arena);
+    free(q);
+}
+
+/* Make room for n elements in queue, the unrolled list needs no memory ahead of time */
+bool q_reserve(struct list_head *head, int n)
+{
+    return head;
+}
+
+/* Insert a copy of @s at one end of queue */
+static bool insert(struct list_head *head, char *s, bool tail)
+{
+    if (!head)
+        return false;
+
+    queue_t *q = queue_of(head);
+    element_t *e = element_new(&q->arena, s);
+    if (!e)
+        return false;
+
+    if (!push(q, e, tail)) {
+        q_release_element(e);
+        return false;
+    }
+    return true;
+}
+
+/* Insert an element at head of queue */
+bool q_insert_head(struct list_head *head, char *s)
+{
+    return insert(head, s, false);
+}
+
+/* Insert an element at tail of queue */
+bool q_insert_tail(struct list_head *head, char *s)
+{
+    return insert(head, s, true);
+}
+
+/* Insert copies of the @n strings in @s one by one, undoing the whole call
+ * if one of them fails.
+ */
+static bool insert_bulk(struct list_head *head, char *s[], int n, bool tail)
+{
+    if (!head || n < 0 || (n && !s))
+        return false;
+
+    queue_t *q = queue_of(head);
+    for (int i = 0; i < n; i++) {
+        element_t *e = element_new(&q->arena, s[i]);
+        if (!e || !push(q, e, tail)) {
+            if (e)
+                q_release_element(e);
+            while (i--)
+                q_release_element(pop(q, tail));
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Insert an array of strings at head of queue */
+bool q_insert_head_bulk(struct list_head *head, char *s[], int n)
+{
+    return insert_bulk(head, s, n, false);
+}
+
+/* Insert an array of strings at tail of queue */
+bool q_insert_tail_bulk(struct list_head *head, char *s[], int n)
+{
+    return insert_bulk(head, s, n, true);
+}
+
+/* Remove the element at one end of queue */
+static element_t *remove_one(struct list_head *head,
+                             char *sp,
+                             size_t bufsize,
+                             bool tail)
+{
+    if (!head || !queue_of(head)->size)
+        return NULL;
+
+    element_t *e = pop(queue_of(head), tail);
+    if (sp)
+        copy_value(sp, bufsize, e);
+    return e;
+}
+
+/* Remove an element from head of queue */
+element_t *q_remove_head(struct list_head *head, char *sp, size_t bufsize)
+{
+    return remove_one(head, sp, bufsize, false);
+}
+
+/* Remove an element from tail of queue */
+element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize)
+{
+    return remove_one(head, sp, bufsize, true);
+}
+
+/* Remove up to @n elements at one end of queue into @out, in queue order */
+static int remove_n(struct list_head *head,
+                    int n,
+                    struct list_head *out,
+                    char *sp,
+                    size_t bufsize,
+                    bool tail)
+{
+    if (!head || !out || n <= 0)
+        return 0;
+
+    queue_t *q = queue_of(head);
+    if (n > q->size)
+        n = q->size;
+    for (int i = 0; i < n; i++) {
+        element_t *e = pop(q, tail);
+        if (tail)
+            list_add(&e->list, out);
+        else
+            list_add_tail(&e->list, out);
+    }
+    pack_strings(out, sp, bufsize);
+    return n;
+}
+
+/* Remove up to n elements from head of queue */
+int q_remove_head_n(struct list_head *head,
+                    int n,
+                    struct list_head *out,
+                    char *sp,
+                    size_t bufsize)
+{
+    return remove_n(head, n, out, sp, bufsize, false);
+}
+
+/* Remove up to n elements from tail of queue */
+int q_remove_tail_n(struct list_head *head,
+                    int n,
+                    struct list_head *out,
+                    char *sp,
+                    size_t bufsize)
+{
+    return remove_n(head, n, out, sp, bufsize, true);
+}
+
+/* Return number of elements in queue */
+int q_size(struct list_head *head)
+{
+    if (!head)
+        return 0;
+
+    return queue_of(head)->size;
+}
+
+/* The element in the slot @it is on, NULL past either end */
+static inline element_t *iter_entry(const q_iter_t *it)
+{
+    const unroll_chunk_t *c = it->pos;
+    return c ? c->slot[it->slot] : NULL;
+}
+
+/* Start a walk at the head of queue */
+element_t *q_first(struct list_head *head, q_iter_t *it)
+{
+    it->head = head;
+    it->pos = NULL;
+    if (head && !list_empty(head)) {
+        unroll_chunk_t *c = chunk_of(head->next);
+        it->pos = c;
+        it->slot = c->begin;
+    }
+    return iter_entry(it);
+}
+
+/* Start a walk at the tail of queue */
+element_t *q_last(struct list_head *head, q_iter_t *it)
+{
+    it->head = head;
+    it->pos = NULL;
+    if (head && !list_empty(head)) {
+        unroll_chunk_t *c = chunk_of(head->prev);
+        it->pos = c;
+        it->slot = c->end - 1;
+    }
+    return iter_entry(it);
+}
+
+/* Move to the next element */
+element_t *q_next(q_iter_t *it)
+{
+    unroll_chunk_t *c = it->pos;
+    if (c && ++it->slot == c->end) {
+        if (c->node.next == it->head) {
+            it->pos = NULL;
+        } else {
+            c = chunk_of(c->node.next);
+            it->pos = c;
+            it->slot = c->begin;
+        }
+    }
+    return iter_entry(it);
+}
+
+/* Move to the previous element */
+element_t *q_prev(q_iter_t *it)
+{
+    unroll_chunk_t *c = it->pos;
+    if (c && it->slot-- == c->begin) {
+        if (c->node.prev == it->head) {
+            it->pos = NULL;
+        } else {
+            c = chunk_of(c->node.prev);
+            it->pos = c;
+            it->slot = c->end - 1;
+        }
+    }
+    return iter_entry(it);
+}
+
+/* The slot @it is on */
+static inline element_t **iter_slot(const q_iter_t *it)
+{
+    return &((unroll_chunk_t *) it->pos)->slot[it->slot];
+}
+
+/* Move @it @n elements towards the tail, staying within the queue */
+static void iter_skip(q_iter_t *it, int n)
+{
+    unroll_chunk_t *c = it->pos;
+    while (it->slot + n >= c->end) {
+        n -= c->end - it->slot;
+        c = chunk_of(c->node.next);
+        it->slot = c->begin;
+    }
+    it->pos = c;
+    it->slot += n;
+}
+
+/* Delete the middle node in queue */
+bool q_delete_mid(struct list_head *head)
+{
+    if (!head || !queue_of(head)->size)
+        return false;
+
+    queue_t *q = queue_of(head);
+    int j;
+    unroll_chunk_t *c = locate(q, (q->size - 1) / 2, &j);
+    q_release_element(take(q, c, j));
+    return true;
+}
+
+/* Return the element at position i */
+element_t *q_at(struct list_head *head, int i)
+{
+    if (!head || i < 0 || i >= queue_of(head)->size)
+        return NULL;
+
+    int j;
+    unroll_chunk_t *c = locate(queue_of(head), i, &j);
+    return c->slot[j];
+}
+
+/* Insert an element at position i */
+bool q_insert_at(struct list_head *head, int i, char *s)
+{
+    if (!head || i < 0 || i > queue_of(head)->size)
+        return false;
+
+    queue_t *q = queue_of(head);
+    if (!i || i == q->size)
+        return insert(head, s, i != 0);
+
+    element_t *e = element_new(&q->arena, s);
+    if (!e)
+        return false;
+
+    /* The new element goes in front of the one now at position i */
+    int j;
+    unroll_chunk_t *c = locate(q, i, &j);
+    if (!c->begin && c->end == UNROLL_SLOTS) {
+        /* Split the full chunk, its second half moves to a new one */
+        unroll_chunk_t *next = chunk_get(q, 0);
+        if (!next) {
+            q_release_element(e);
+            return false;
+        }
+        int half = UNROLL_SLOTS / 2;
+        memcpy(next->slot, c->slot + half, half * sizeof(element_t *));
+        next->end = half;
+        c->end = half;
+        list_add(&next->node, &c->node);
+        if (j >= half) {
+            c = next;
+            j -= half;
+        }
+    }
+
+    if (c->begin && (j - c->begin <= c->end - j || c->end == UNROLL_SLOTS)) {
+        memmove(c->slot + c->begin - 1, c->slot + c->begin,
+                (j - c->begin) * sizeof(element_t *));
+        c->begin--;
+        j--;
+    } else {
+        memmove(c->slot + j + 1, c->slot + j,
+                (c->end - j) * sizeof(element_t *));
+        c->end++;
+    }
+    c->slot[j] = e;
+    q->size++;
+    return true;
+}
+
+/* Delete the element at position i */
+bool q_delete_at(struct list_head *head, int i)
+{
+    if (!head || i < 0 || i >= queue_of(head)->size)
+        return false;
+
+    queue_t *q = queue_of(head);
+    int j;
+    unroll_chunk_t *c = locate(q, i, &j);
+    q_release_element(take(q, c, j));
+    return true;
+}
+
+/* Delete all nodes that have duplicate string */
+bool q_delete_dup(struct list_head *head)
+{
+    if (!head || !queue_of(head)->size)
+        return false;
+
+    queue_t *q = queue_of(head);
+    q_iter_t it, cur;
+    element_t *e = q_first(head, &it);
+    bool dup = false;
+
+    while (e) {
+        cur = it;
+        element_t *next = q_next(&it);
+        bool same = next && !element_cmp(e, next);
+        if (same || dup) {
+            *iter_slot(&cur) = NULL;
+            q_release_element(e);
+            q->size--;
+        }
+        dup = same;
+        e = next;
+    }
+    sweep(q);
+    return true;
+}
+
+bool q_delete_dup_unsorted(struct list_head *head)
+{
+    if (!head || !queue_of(head)->size)
+        return false;
+
+    queue_t *q = queue_of(head);
+    dup_table_t t;
+    if (!dup_table_build(&t, head))
+        return false;
+
+    /* The table points into the queue: set the repeated elements aside on
+     * their unused list nodes, and release them once it is gone.
+     */
+    LIST_HEAD(doomed);
+    q_iter_t it;
+    for (element_t *e = q_first(head, &it); e; e = q_next(&it)) {
+        if (dup_table_repeated(&t, e)) {
+            *iter_slot(&it) = NULL;
+            list_add_tail(&e->list, &doomed);
+            q->size--;
+        }
+    }
+    dup_table_free(&t);
+    sweep(q);
+
+    element_t *e, *safe;
+    list_for_each_entry_safe (e, safe, &doomed, list)
+        q_release_element(e);
+    return true;
+}
+
+/* Reverse the elements of @q in groups of @k. A trailing group shorter than
+ * @k is left as it is. Elements trade slots, the chunks stay in place.
+ */
+static void reverse_groups(queue_t *q, int k)
+{
+    q_iter_t lo, hi, next;
+    q_first(&q->head, &lo);
+
+    for (int n = q->size / k; n; n--) {
+        hi = lo;
+        iter_skip(&hi, k - 1);
+        next = hi;
+        q_next(&next);
+        for (int i = k / 2; i; i--) {
+            element_t *tmp = *iter_slot(&lo);
+            *iter_slot(&lo) = *iter_slot(&hi);
+            *iter_slot(&hi) = tmp;
+            q_next(&lo);
+            q_prev(&hi);
+        }
+        lo = next;
+    }
+}
+
+/* Swap every two adjacent nodes */
+void q_swap(struct list_head *head)
+{
+    if (!head || queue_of(head)->size < 2)
+        return;
+
+    reverse_groups(queue_of(head), 2);
+}
+
+/* Reverse elements in queue */
+void q_reverse(struct list_head *head)
+{
+    if (!head || list_empty(head))
+        return;
+
+    /* Reverse the order of the chunks, and the slots within each chunk */
+    queue_of(head)->finger = NULL;
+    struct list_head *node = head, *tmp;
+    do {
+        tmp = node->next;
+        node->next = node->prev;
+        node->prev = tmp;
+        node = tmp;
+        if (node != head) {
+            unroll_chunk_t *c = chunk_of(node);
+            for (int i = c->begin, j = c->end - 1; i < j; i++, j--) {
+                element_t *e = c->slot[i];
+                c->slot[i] = c->slot[j];
+                c->slot[j] = e;
+            }
+        }
+    } while (node != head);
+}
+
+/* Reverse the nodes of the list k at a time */
+void q_reverseK(struct list_head *head, int k)
+{
+    if (!head || list_empty(head) || k <= 1)
+        return;
+
+    reverse_groups(queue_of(head), k);
+}
+
+/* Sort the queue with the algorithm selected by sort_algo. The elements are
+ * linked into a list for the sort, then laid out again in the same chunks.
+ */
+void q_sort(struct list_head *head, bool descend)
+{
+    if (!head || queue_of(head)->size < 2)
+        return;
+
+    queue_t *q = queue_of(head);
+    struct list_head *first = thread(q);
+    LIST_HEAD(pool);
+    list_splice_init(&q->head, &pool);
+    refill(q, &pool, sort_list(first, q->size, descend));
+}
+
+/* Remove every node which has a node strictly in front of it, in the given
+ * order, anywhere to its right. A single pass from the tail keeps track of
+ * the smallest (or largest) value seen so far, which is the last node kept.
+ */
+static int q_keep_monotonic(struct list_head *head, bool descend)
+{
+    if (!head || !queue_of(head)->size)
+        return 0;
+
+    queue_t *q = queue_of(head);
+    q_iter_t it;
+    element_t *kept = q_last(head, &it), *e;
+
+    while ((e = q_prev(&it))) {
+        int cmp = element_cmp(e, kept);
+        if (descend ? cmp < 0 : cmp > 0) {
+            *iter_slot(&it) = NULL;
+            q_release_element(e);
+            q->size--;
+        } else {
+            kept = e;
+        }
+    }
+    sweep(q);
+
+    return q->size;
+}
+
+/* Remove every node which has a node with a strictly less value anywhere to
+ * the right side of it */
+int q_ascend(struct list_head *head)
+{
+    return q_keep_monotonic(head, false);
+}
+
+/* Remove every node which has a node with a strictly greater value anywhere to
+ * the right side of it */
+int q_descend(struct list_head *head)
+{
+    return q_keep_monotonic(head, true);
+}
+
+/* Merge all the queues into one sorted queue, which is in
+ * ascending/descending order */
+int q_merge(struct list_head *head, bool descend)
+{
+    if (!head || list_empty(head)) {
+        return 0;
+    }
+
+    queue_contex_t *base_queue = list_first_entry(head, queue_contex_t, chain);
+    if (!base_queue->q)
+        return 0;
+    if (list_is_singular(head)) {
+        return q_size(base_queue->q);
+    }
+
+    struct list_head *lists[MERGE_MAX_WAYS];
+    queue_t *base = queue_of(base_queue->q);
+    struct list_head *current = base_queue->chain.next;
+
+    while (current != head) {
+        int n = 0;
+
+        /* The chunks of all the queues merged in this pass end up in @pool,
+         * which has room for all of their elements.
+         */
+        LIST_HEAD(pool);
+        if (base->size)
+            lists[n++] = thread(base);
+        list_splice_init(&base->head, &pool);
+
+        for (; n < MERGE_MAX_WAYS && current != head; current = current->next) {
+            queue_contex_t *ctx = list_entry(current, queue_contex_t, chain);
+            if (!ctx->q)
+                continue;
+
+            queue_t *q = queue_of(ctx->q);
+            if (q->size)
+                lists[n++] = thread(q);
+            list_splice_tail_init(&q->head, &pool);
+            list_splice_init(&q->spare, &base->spare);
+            arena_adopt(&base->arena, &q->arena);
+            base->size += q->size;
+            q->size = 0;
+            q->finger = NULL;
+        }
+
+        refill(base, &pool, n ? merge_lists(lists, n, descend) : NULL);
+    }
+
+    base_queue->size = base->size;
+    return base->size;
+}
+
+/* Move the pooled strings into a single block, in queue order */
+bool q_compact(struct list_head *head)
+{
+    return head && pool_compact(&queue_of(head)->arena, head);
+}
@@ -0,0 +1,136 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+
+/* The requests themselves use regular malloc/free, the queues they carry are
+ * released through the backend as usual.
+ */
+#define INTERNAL 1
+#include "harness.h"
+
+#include "intern.h"
+#include "queue.h"
+#include "reclaim.h"
+
+typedef struct __reclaim_req {
+    struct list_head *head;
+    bool cautious;
+    struct __reclaim_req *next;
+} reclaim_req_t;
+
+/**
+ * reclaimer - State of the reclaimer thread
+ * @lock: guards every other field
+ * @work: signaled when a request arrives or the thread has to quit
+ * @idle: signaled when @pending drops to zero
+ * @first: oldest request not taken yet
+ * @last: where the next request goes
+ * @pending: number of requests not completed yet, taken ones included
+ * @running: whether @thread was started
+ * @quit: tells the thread to exit once @pending drops to zero
+ * @thread: the reclaimer thread
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work, idle;
+    reclaim_req_t *first, **last;
+    int pending;
+    bool running, quit;
+    pthread_t thread;
+} reclaimer = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .idle = PTHREAD_COND_INITIALIZER,
+    .last = &reclaimer.first,
+};
+
+static void *reclaimer_main(void *unused)
+{
+    pthread_mutex_lock(&reclaimer.lock);
+    for (;;) {
+        reclaim_req_t *req = reclaimer.first;
+        if (!req) {
+            if (reclaimer.quit)
+                break;
+            pthread_cond_wait(&reclaimer.work, &reclaimer.lock);
+            continue;
+        }
+        reclaimer.first = req->next;
+        if (!reclaimer.first)
+            reclaimer.last = &reclaimer.first;
+        pthread_mutex_unlock(&reclaimer.lock);
+
+        set_background_free(req->cautious);
+        q_free(req->head);
+        free(req);
+
+        pthread_mutex_lock(&reclaimer.lock);
+        if (!--reclaimer.pending)
+            pthread_cond_broadcast(&reclaimer.idle);
+    }
+    pthread_mutex_unlock(&reclaimer.lock);
+    return NULL;
+}
+
+bool reclaim_start()
+{
+    if (reclaimer.running)
+        return true;
+
+    /* Signals such as the timer of exception_setup() are for the main thread
+     * alone, and the thread inherits the mask it is created with.
+     */
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &saved);
+    set_shared_heap();
+    reclaimer.quit = false;
+    reclaimer.running =
+        !pthread_create(&reclaimer.thread, NULL, reclaimer_main, NULL);
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+
+    if (reclaimer.running)
+        set_allocation_waiter(reclaim_wait);
+    return reclaimer.running;
+}
+
+bool reclaim_queue(struct list_head *head, bool cautious)
+{
+    if (!reclaimer.running || intern_count())
+        return false;
+    reclaim_req_t *req = malloc(sizeof(reclaim_req_t));
+    if (!req)
+        return false;
+    req->head = head;
+    req->cautious = cautious;
+    req->next = NULL;
+
+    pthread_mutex_lock(&reclaimer.lock);
+    *reclaimer.last = req;
+    reclaimer.last = &req->next;
+    reclaimer.pending++;
+    pthread_cond_signal(&reclaimer.work);
+    pthread_mutex_unlock(&reclaimer.lock);
+    return true;
+}
+
+void reclaim_wait()
+{
+    pthread_mutex_lock(&reclaimer.lock);
+    while (reclaimer.pending)
+        pthread_cond_wait(&reclaimer.idle, &reclaimer.lock);
+    pthread_mutex_unlock(&reclaimer.lock);
+}
+
+void reclaim_stop()
+{
+    if (!reclaimer.running)
+        return;
+    pthread_mutex_lock(&reclaimer.lock);
+    reclaimer.quit = true;
+    pthread_cond_signal(&reclaimer.work);
+    pthread_mutex_unlock(&reclaimer.lock);
+    pthread_join(reclaimer.thread, NULL);
+    reclaimer.running = false;
+    set_allocation_waiter(NULL);
+}
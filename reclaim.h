@@ -0,0 +1,53 @@
+#ifndef LAB0_RECLAIM_H
+#define LAB0_RECLAIM_H
+
+/* Release of queues on a background thread.
+ *
+ * Freeing a long queue, or every queue of the chain on quit, keeps the
+ * console busy for as long as it takes to return each chunk of the queue's
+ * arena to the allocator. Once reclaim_start() has been called, a queue can
+ * instead be handed over with reclaim_queue() in O(1): a single reclaimer
+ * thread frees the queues in the order they were handed over, one arena
+ * chunk, that is one batch of nodes, at a time.
+ *
+ * The allocation checker of harness.c is switched to shared mode, so that
+ * the reclaimer frees blocks while the main thread keeps allocating, and
+ * allocation_check() waits for every pending queue to be released, so leak
+ * reports stay exact.
+ */
+
+#include <stdbool.h>
+
+#include "list.h"
+
+/**
+ * reclaim_start() - Start the reclaimer thread, if not running already
+ *
+ * Return: true for success, false if the thread could not be created
+ */
+bool reclaim_start();
+
+/**
+ * reclaim_queue() - Hand a queue over to the reclaimer thread
+ * @head: header of the queue, which no one may use afterwards
+ * @cautious: whether the blocks of the queue are checked before being freed,
+ *            see set_cautious_mode()
+ *
+ * The interned strings table is not thread-safe, so queues are not taken
+ * while it holds strings. The decision is made here, on the calling thread:
+ * a queue handed over holds no interned string, and freeing it only reads
+ * intern_count(), whatever the calling thread interns meanwhile.
+ *
+ * Return: true if the queue will be freed in the background, false if the
+ * caller has to free it, which happens if the reclaimer is not running or
+ * there is no memory to queue the request.
+ */
+bool reclaim_queue(struct list_head *head, bool cautious);
+
+/* Wait for the queues handed over so far to be released */
+void reclaim_wait();
+
+/* Release the pending queues, then stop the reclaimer thread */
+void reclaim_stop();
+
+#endif /* LAB0_RECLAIM_H */
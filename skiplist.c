@@ -0,0 +1,195 @@
+#include <stdint.h>
+
+#include "skiplist.h"
+
+/**
+ * skip_node_t - A tower of forward links
+ * @node: the indexed list node, NULL for the sentinel
+ * @chunk: arena chunk the tower was carved from
+ * @level: number of links in @link
+ * @link: forward links, @width counts the positions up to @next, or up to
+ *        the end of the list when @next is NULL
+ */
+typedef struct __skip_node {
+    struct list_head *node;
+    arena_chunk_t *chunk;
+    int level;
+    struct {
+        struct __skip_node *next;
+        int width;
+    } link[];
+} skip_node_t;
+
+static inline size_t tower_size(int level)
+{
+    return sizeof(skip_node_t) + level * sizeof(((skip_node_t *) 0)->link[0]);
+}
+
+static skip_node_t *tower_new(arena_t *a, int level, struct list_head *node)
+{
+    arena_chunk_t *chunk;
+    skip_node_t *x = arena_alloc(a, tower_size(level), &chunk);
+    if (!x)
+        return NULL;
+
+    x->node = node;
+    x->chunk = chunk;
+    x->level = level;
+    return x;
+}
+
+/* Tower heights only need to be independent of the data, so a fixed-seed
+ * xorshift generator is good enough and keeps runs reproducible.
+ */
+static int random_level(void)
+{
+    static uint32_t state = 2463534242;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+
+    int level = 1;
+    for (uint32_t r = state; level < SKIP_MAX_LEVEL && !(r & 3); r >>= 2)
+        level++;
+    return level;
+}
+
+/* Record in @update the last tower before position @i on every level, and in
+ * @pos the positions of those towers. The sentinel sits at position -1.
+ */
+static void find_before(const skiplist_t *s,
+                        int i,
+                        skip_node_t **update,
+                        int *pos)
+{
+    skip_node_t *x = s->head;
+    int p = -1;
+    for (int l = SKIP_MAX_LEVEL - 1; l >= 0; l--) {
+        while (x->link[l].next && p + x->link[l].width < i) {
+            p += x->link[l].width;
+            x = x->link[l].next;
+        }
+        update[l] = x;
+        pos[l] = p;
+    }
+}
+
+void skip_init(skiplist_t *s)
+{
+    s->head = NULL;
+    s->size = 0;
+}
+
+bool skip_build(skiplist_t *s, arena_t *a, struct list_head *list)
+{
+    s->head = tower_new(a, SKIP_MAX_LEVEL, NULL);
+    if (!s->head)
+        return false;
+
+    skip_node_t *last[SKIP_MAX_LEVEL];
+    int pos[SKIP_MAX_LEVEL];
+    for (int l = 0; l < SKIP_MAX_LEVEL; l++) {
+        last[l] = s->head;
+        pos[l] = -1;
+    }
+
+    /* Towers are appended in list order, so each level is linked up by
+     * remembering the last tower which reached it.
+     */
+    int n = 0;
+    struct list_head *node;
+    list_for_each (node, list) {
+        skip_node_t *x = tower_new(a, random_level(), node);
+        if (!x) {
+            for (int l = 0; l < SKIP_MAX_LEVEL; l++)
+                last[l]->link[l].next = NULL;
+            skip_drop(s);
+            return false;
+        }
+        for (int l = 0; l < x->level; l++) {
+            last[l]->link[l].next = x;
+            last[l]->link[l].width = n - pos[l];
+            last[l] = x;
+            pos[l] = n;
+        }
+        n++;
+    }
+
+    for (int l = 0; l < SKIP_MAX_LEVEL; l++) {
+        last[l]->link[l].next = NULL;
+        last[l]->link[l].width = n - pos[l];
+    }
+    s->size = n;
+    return true;
+}
+
+void skip_drop(skiplist_t *s)
+{
+    skip_node_t *x = s->head;
+    while (x) {
+        skip_node_t *next = x->link[0].next;
+        arena_free(x->chunk, x, tower_size(x->level));
+        x = next;
+    }
+    skip_init(s);
+}
+
+struct list_head *skip_at(const skiplist_t *s, int i)
+{
+    skip_node_t *x = s->head;
+    int p = -1;
+    for (int l = SKIP_MAX_LEVEL - 1; l >= 0; l--) {
+        while (x->link[l].next && p + x->link[l].width <= i) {
+            p += x->link[l].width;
+            x = x->link[l].next;
+        }
+    }
+    return x->node;
+}
+
+bool skip_insert(skiplist_t *s, arena_t *a, int i, struct list_head *node)
+{
+    skip_node_t *x = tower_new(a, random_level(), node);
+    if (!x)
+        return false;
+
+    skip_node_t *update[SKIP_MAX_LEVEL];
+    int pos[SKIP_MAX_LEVEL];
+    find_before(s, i, update, pos);
+
+    for (int l = 0; l < SKIP_MAX_LEVEL; l++) {
+        if (l < x->level) {
+            /* The link over position i is split by the new tower */
+            x->link[l].next = update[l]->link[l].next;
+            x->link[l].width = update[l]->link[l].width - (i - pos[l]) + 1;
+            update[l]->link[l].next = x;
+            update[l]->link[l].width = i - pos[l];
+        } else {
+            update[l]->link[l].width++;
+        }
+    }
+    s->size++;
+    return true;
+}
+
+struct list_head *skip_delete(skiplist_t *s, int i)
+{
+    skip_node_t *update[SKIP_MAX_LEVEL];
+    int pos[SKIP_MAX_LEVEL];
+    find_before(s, i, update, pos);
+
+    skip_node_t *x = update[0]->link[0].next;
+    for (int l = 0; l < SKIP_MAX_LEVEL; l++) {
+        if (l < x->level) {
+            update[l]->link[l].width += x->link[l].width - 1;
+            update[l]->link[l].next = x->link[l].next;
+        } else {
+            update[l]->link[l].width--;
+        }
+    }
+    s->size--;
+
+    struct list_head *node = x->node;
+    arena_free(x->chunk, x, tower_size(x->level));
+    return node;
+}
@@ -0,0 +1,90 @@
+#ifndef LAB0_SKIPLIST_H
+#define LAB0_SKIPLIST_H
+
+/* Indexable skip list over the nodes of a list.
+ *
+ * Every list node gets a tower of forward links, each annotated with the
+ * number of positions it skips. Walking down the towers finds the node at a
+ * given position in O(log n) expected steps, and the same walk locates the
+ * links to patch when a node is inserted or deleted at a position. Towers
+ * are carved from an arena, so dropping a node never calls free() for it.
+ */
+
+#include <stdbool.h>
+
+#include "arena.h"
+#include "list.h"
+
+/* Maximum height of a tower. Heights are picked with probability 1/4 per
+ * extra level, which keeps searches logarithmic up to about 4^12 nodes.
+ */
+#define SKIP_MAX_LEVEL 12
+
+struct __skip_node;
+
+/**
+ * skiplist_t - Positional index over a list
+ * @head: tower of the sentinel in front of position 0, NULL if not built
+ * @size: number of nodes indexed
+ */
+typedef struct {
+    struct __skip_node *head;
+    int size;
+} skiplist_t;
+
+/**
+ * skip_init() - Initialize an empty index, no memory is allocated
+ * @s: index to be initialized
+ */
+void skip_init(skiplist_t *s);
+
+/**
+ * skip_build() - Index every node of a list, in list order
+ * @s: an empty index
+ * @a: arena the towers are allocated from
+ * @list: the list to index
+ *
+ * Return: true for success, false if allocation failed, @s is left empty
+ */
+bool skip_build(skiplist_t *s, arena_t *a, struct list_head *list);
+
+/**
+ * skip_drop() - Release every tower of the index and leave it empty
+ * @s: the index
+ */
+void skip_drop(skiplist_t *s);
+
+/**
+ * skip_at() - Find the node at a position
+ * @s: the index
+ * @i: position, from 0 to @s->size - 1
+ *
+ * Return: the list node at position @i
+ */
+struct list_head *skip_at(const skiplist_t *s, int i);
+
+/**
+ * skip_insert() - Index a node inserted at a position
+ * @s: the index
+ * @a: arena the tower is allocated from
+ * @i: position of the new node, from 0 to @s->size
+ * @node: the new list node
+ *
+ * The nodes at positions @i and above move up by one.
+ *
+ * Return: true for success, false if allocation failed
+ */
+bool skip_insert(skiplist_t *s, arena_t *a, int i, struct list_head *node);
+
+/**
+ * skip_delete() - Remove the node at a position from the index
+ * @s: the index
+ * @i: position, from 0 to @s->size - 1
+ *
+ * Only the tower is released, the list node itself is left alone.
+ *
+ * Return: the list node which was at position @i
+ */
+struct list_head *skip_delete(skiplist_t *s, int i);
+
+#endif /* LAB0_SKIPLIST_H */
@@ -0,0 +1,125 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* The array of strings uses regular malloc/free, only the queue allocates
+ * through the harness.
+ */
+#define INTERNAL 1
+#include "harness.h"
+
+#include "queue.h"
+#include "snapshot.h"
+
+bool snapshot_save(struct list_head *head, const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+
+    uint64_t n = q_size(head);
+    bool ok = fwrite(SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LEN, 1, f) == 1 &&
+              fwrite(&n, sizeof(n), 1, f) == 1;
+    q_iter_t it;
+    for (element_t *e = q_first(head, &it); ok && e; e = q_next(&it)) {
+        uint32_t len = e->len;
+        ok = fwrite(&len, sizeof(len), 1, f) == 1 &&
+             fwrite(e->value, 1, (size_t) len + 1, f) == (size_t) len + 1;
+    }
+
+    int err = errno;
+    if (fclose(f) && ok) {
+        ok = false;
+        err = errno;
+    }
+    if (!ok) {
+        unlink(path);
+        errno = err;
+    }
+    return ok;
+}
+
+/* Point @s->strs at the strings of the mapping. Return 0 for success,
+ * ENOMEM if no memory for the array, EINVAL if the snapshot is malformed.
+ */
+static int snapshot_parse(snapshot_t *s)
+{
+    const char *p = s->map, *end = p + s->size;
+    uint64_t n;
+    if (s->size < SNAPSHOT_MAGIC_LEN + sizeof(n) ||
+        memcmp(p, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LEN))
+        return EINVAL;
+    p += SNAPSHOT_MAGIC_LEN;
+    memcpy(&n, p, sizeof(n));
+    p += sizeof(n);
+
+    /* Every string takes at least a length and a terminator */
+    if (n > INT_MAX || n > (size_t) (end - p) / (sizeof(uint32_t) + 1))
+        return EINVAL;
+    s->strs = malloc(sizeof(char *) * (n ? n : 1));
+    if (!s->strs)
+        return ENOMEM;
+
+    for (uint64_t i = 0; i < n; i++) {
+        uint32_t len;
+        if ((size_t) (end - p) < sizeof(len))
+            return EINVAL;
+        memcpy(&len, p, sizeof(len));
+        p += sizeof(len);
+        if ((size_t) (end - p) <= len || p[len])
+            return EINVAL;
+        s->strs[i] = (char *) p;
+        p += (size_t) len + 1;
+    }
+    s->n = n;
+    return p == end ? 0 : EINVAL;
+}
+
+bool snapshot_open(snapshot_t *s, const char *path)
+{
+    *s = (snapshot_t){.map = MAP_FAILED};
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    int err = 0;
+    if (fstat(fd, &st)) {
+        err = errno;
+    } else if (!st.st_size) {
+        err = EINVAL;
+    } else {
+        s->size = st.st_size;
+        s->map = mmap(NULL, s->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (s->map == MAP_FAILED)
+            err = errno;
+    }
+    close(fd);
+
+    if (!err) {
+        /* The strings are read once, from the first to the last */
+        madvise(s->map, s->size, MADV_SEQUENTIAL);
+        err = snapshot_parse(s);
+    }
+    if (err) {
+        snapshot_close(s);
+        errno = err;
+        return false;
+    }
+    return true;
+}
+
+void snapshot_close(snapshot_t *s)
+{
+    if (s->map != MAP_FAILED)
+        munmap(s->map, s->size);
+    free(s->strs);
+    *s = (snapshot_t){.map = MAP_FAILED};
+}
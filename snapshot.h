@@ -0,0 +1,61 @@
+#ifndef LAB0_SNAPSHOT_H
+#define LAB0_SNAPSHOT_H
+
+/* Binary snapshots of the strings of a queue.
+ *
+ * A snapshot starts with the SNAPSHOT_MAGIC bytes and the number of strings
+ * as a 64-bit integer, followed by the strings from head to tail. Each one
+ * is stored as its length, a 32-bit integer, then its characters and a null
+ * terminator. Integers are in the byte order of the machine.
+ *
+ * Thanks to the terminators, a snapshot is loaded by mapping the file and
+ * pointing straight into it: the strings are handed to q_insert_tail_bulk()
+ * as they are, without being copied first.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "list.h"
+
+#define SNAPSHOT_MAGIC "lab0-q1\n"
+#define SNAPSHOT_MAGIC_LEN 8
+
+/**
+ * snapshot_t - A snapshot mapped in memory
+ * @map: the mapping of the file
+ * @size: size of @map in bytes
+ * @strs: the strings of the snapshot, pointing into @map
+ * @n: number of strings in @strs
+ */
+typedef struct {
+    void *map;
+    size_t size;
+    char **strs;
+    int n;
+} snapshot_t;
+
+/**
+ * snapshot_save() - Write the strings of a queue to a file
+ * @head: header of queue
+ * @path: file to be created or overwritten
+ *
+ * Return: true for success, false with errno set if the file could not be
+ * written
+ */
+bool snapshot_save(struct list_head *head, const char *path);
+
+/**
+ * snapshot_open() - Map a snapshot file and check its contents
+ * @s: the snapshot to fill in
+ * @path: the file
+ *
+ * Return: true for success, false with errno set if the file could not be
+ * mapped, or to EINVAL if it is not a well-formed snapshot
+ */
+bool snapshot_open(snapshot_t *s, const char *path);
+
+/* Unmap a snapshot opened with snapshot_open() */
+void snapshot_close(snapshot_t *s);
+
+#endif /* LAB0_SNAPSHOT_H */
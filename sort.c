@@ -0,0 +1,944 @@
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+
+/* Sorting allocates nothing, only the exception hooks of the harness are
+ * used here.
+ */
+#define INTERNAL 1
+#include "harness.h"
+
+#include "element.h"
+#include "sort.h"
+
+/* Compare the strings of two list nodes, the sign follows strcmp() */
+static inline int node_cmp(const struct list_head *a, const struct list_head *b)
+{
+    return element_cmp(list_entry(a, element_t, list),
+                       list_entry(b, element_t, list));
+}
+
+/* Like node_cmp(), but relative to the requested order */
+static inline int order(const struct list_head *x,
+                        const struct list_head *y,
+                        bool descend)
+{
+    int cmp = node_cmp(x, y);
+    return descend ? -cmp : cmp;
+}
+
+/* Whether node @x belongs in front of node @y in the requested order. With
+ * @strict, equal nodes are not considered to be in front of each other.
+ */
+static inline bool before(const struct list_head *x,
+                          const struct list_head *y,
+                          bool strict,
+                          bool descend)
+{
+    int cmp = order(x, y, descend);
+    return strict ? cmp < 0 : cmp <= 0;
+}
+
+/* Walk @n nodes ahead through @next, NULL if the list ends first */
+static inline struct list_head *skip(struct list_head *node, int n)
+{
+    while (node && n--)
+        node = node->next;
+    return node;
+}
+
+/* Once one side wins this many times in a row, merge() starts galloping */
+#define SORT_MIN_GALLOP 7
+
+/* Runs shorter than this are extended by insertion sort */
+#define SORT_MIN_RUN 16
+
+/* Enough for any list which fits in memory, since the run lengths on the
+ * stack grow at least as fast as the Fibonacci numbers.
+ */
+#define SORT_MAX_RUNS 96
+
+/**
+ * gallop() - Find how far a run can be taken at once during a merge
+ * @x: first node of the run, known to belong in front of @y
+ * @y: head of the other run
+ * @strict: passed to before()
+ * @descend: passed to before()
+ *
+ * Linked lists have no random access, so the nodes are still visited, but
+ * only O(log k) of the k nodes taken are compared: probes are placed at
+ * exponentially growing distances, then the last interval is bisected.
+ *
+ * Return: the last node of the run starting at @x which belongs in front of @y
+ */
+static struct list_head *gallop(struct list_head *x,
+                                struct list_head *y,
+                                bool strict,
+                                bool descend)
+{
+    struct list_head *probe;
+    int step = 1;
+
+    for (;;) {
+        probe = skip(x, step);
+        if (!probe || !before(probe, y, strict, descend))
+            break;
+        x = probe;
+        step <<= 1;
+    }
+
+    /* @x belongs in front of @y, the node @step ahead of it does not */
+    while (step > 1) {
+        int half = step >> 1;
+        probe = skip(x, half);
+        if (probe && before(probe, y, strict, descend)) {
+            x = probe;
+            step -= half;
+        } else {
+            step = half;
+        }
+    }
+    return x;
+}
+
+/* A sorted run, null-terminated through @next */
+typedef struct {
+    struct list_head *head, *tail;
+    size_t len;
+} sort_run_t;
+
+/* Merge run @b into run @a, which holds the earlier nodes. Ties are taken
+ * from @a first, which keeps the sort stable.
+ */
+static void merge(sort_run_t *a, const sort_run_t *b, bool descend)
+{
+    /* Runs which do not overlap are simply concatenated */
+    if (before(a->tail, b->head, false, descend)) {
+        a->tail->next = b->head;
+        a->tail = b->tail;
+        a->len += b->len;
+        return;
+    }
+    if (before(b->tail, a->head, true, descend)) {
+        b->tail->next = a->head;
+        a->head = b->head;
+        a->len += b->len;
+        return;
+    }
+
+    struct list_head *x = a->head, *y = b->head, *last;
+    struct list_head *head = NULL, **tail = &head;
+    int wins_x = 0, wins_y = 0;
+
+    for (;;) {
+        if (before(x, y, false, descend)) {
+            wins_y = 0;
+            last = ++wins_x >= SORT_MIN_GALLOP ? gallop(x, y, false, descend)
+                                               : x;
+            *tail = x;
+            tail = &last->next;
+            x = last->next;
+            if (!x) {
+                *tail = y;
+                a->tail = b->tail;
+                break;
+            }
+        } else {
+            wins_x = 0;
+            last = ++wins_y >= SORT_MIN_GALLOP ? gallop(y, x, true, descend)
+                                               : y;
+            *tail = y;
+            tail = &last->next;
+            y = last->next;
+            if (!y) {
+                *tail = x;
+                break;
+            }
+        }
+    }
+    a->head = head;
+    a->len += b->len;
+}
+
+/* Cut the next run off the list starting at @node. Runs going the wrong way
+ * are reversed in place, and short runs are extended to SORT_MIN_RUN nodes
+ * by insertion sort. Return the node following the run.
+ */
+static struct list_head *next_run(struct list_head *node,
+                                  sort_run_t *run,
+                                  bool descend)
+{
+    struct list_head *next = node->next;
+
+    run->head = run->tail = node;
+    run->len = 1;
+
+    if (next && before(next, node, true, descend)) {
+        /* Reverse the run by pushing each node in front. Nodes equal to the
+         * current front go behind the last of them instead, so equal nodes
+         * keep their order and the sort stays stable.
+         */
+        struct list_head *equal = node;
+        int cmp = -1;
+        do {
+            struct list_head *after = next->next;
+            if (cmp < 0) {
+                next->next = run->head;
+                run->head = next;
+            } else {
+                next->next = equal->next;
+                equal->next = next;
+            }
+            equal = next;
+            run->len++;
+            next = after;
+        } while (next && (cmp = order(next, run->head, descend)) <= 0);
+    } else {
+        while (next && !before(next, run->tail, true, descend)) {
+            run->tail = next;
+            run->len++;
+            next = next->next;
+        }
+    }
+    run->tail->next = NULL;
+
+    while (next && run->len < SORT_MIN_RUN) {
+        node = next;
+        next = next->next;
+        if (!before(node, run->tail, true, descend)) {
+            run->tail->next = node;
+            run->tail = node;
+            node->next = NULL;
+        } else {
+            struct list_head **pos = &run->head;
+            while (!before(node, *pos, true, descend))
+                pos = &(*pos)->next;
+            node->next = *pos;
+            *pos = node;
+        }
+        run->len++;
+    }
+    return next;
+}
+
+/* Merge the runs at @i and @i + 1 on the stack of @n runs */
+static void merge_at(sort_run_t *runs, int i, int n, bool descend)
+{
+    merge(&runs[i], &runs[i + 1], descend);
+    if (i + 2 < n)
+        runs[i + 1] = runs[i + 2];
+}
+
+/* Sort a null-terminated list with a natural merge sort in the spirit of
+ * Timsort. The list is cut into the runs it already contains, descending
+ * runs are reversed in place, and runs are merged following the Timsort
+ * stack rules so that merges stay balanced. Merging galloping over long
+ * stretches and concatenating runs which do not overlap make already sorted
+ * or reversed input O(n).
+ */
+static void merge_sort(sort_run_t *list, bool descend)
+{
+    sort_run_t runs[SORT_MAX_RUNS];
+    struct list_head *node = list->head;
+    int n = 0;
+
+    while (node) {
+        node = next_run(node, &runs[n++], descend);
+
+        /* Keep run lengths decreasing faster than the Fibonacci numbers */
+        while (n > 1) {
+            int i = n - 2;
+            if ((i > 0 && runs[i - 1].len <= runs[i].len + runs[i + 1].len) ||
+                (i > 1 && runs[i - 2].len <= runs[i - 1].len + runs[i].len)) {
+                if (runs[i - 1].len < runs[i + 1].len)
+                    i--;
+            } else if (runs[i].len > runs[i + 1].len) {
+                break;
+            }
+            merge_at(runs, i, n, descend);
+            n--;
+        }
+    }
+    for (; n > 1; n--)
+        merge_at(runs, n - 2, n, descend);
+
+    *list = runs[0];
+}
+
+/* Lists shorter than this are handed over to merge_sort() */
+#define RADIX_CUTOFF 64
+
+/* Number of leading bytes available in element_t.key */
+#define RADIX_MAX_DEPTH 8
+
+/* Sort a null-terminated list with an MSD radix sort. Nodes are distributed
+ * into one bucket per byte value at @depth by splicing, without comparing
+ * them, and each bucket is sorted on the following byte. The bytes come from
+ * the cached key prefix, so strings are never touched. Short buckets, and
+ * buckets whose strings agree on the whole prefix, go to merge_sort().
+ */
+static void radix_sort(sort_run_t *list, int depth, bool descend)
+{
+    if (list->len < RADIX_CUTOFF || depth == RADIX_MAX_DEPTH) {
+        merge_sort(list, descend);
+        return;
+    }
+
+    sort_run_t buckets[256];
+    int shift = 56 - 8 * depth;
+
+    memset(buckets, 0, sizeof(buckets));
+    for (struct list_head *node = list->head; node; node = node->next) {
+        uint64_t key = list_entry(node, element_t, list)->key;
+        sort_run_t *b = &buckets[(key >> shift) & 0xff];
+        if (b->len++)
+            b->tail->next = node;
+        else
+            b->head = node;
+        b->tail = node;
+    }
+
+    struct list_head *head = NULL, **tail = &head;
+    for (int i = 0; i < 256; i++) {
+        sort_run_t *b = &buckets[descend ? 255 - i : i];
+        if (!b->len)
+            continue;
+        b->tail->next = NULL;
+
+        /* Strings in bucket 0 ended before @depth, so they are all equal */
+        if (b != &buckets[0])
+            radix_sort(b, depth + 1, descend);
+        *tail = b->head;
+        tail = &b->tail->next;
+        list->tail = b->tail;
+    }
+    list->head = head;
+}
+
+/* Arrays shorter than this are left to insertion sort by intro_sort() */
+#define SORT_INSERTION 16
+
+/* Whether @a belongs strictly in front of @b in the requested order */
+static inline bool less(const element_t *a, const element_t *b, bool descend)
+{
+    int cmp = element_cmp(a, b);
+    return descend ? cmp > 0 : cmp < 0;
+}
+
+static inline void swap_elements(element_t **a, element_t **b)
+{
+    element_t *tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+static void insertion_sort(element_t **v, size_t n, bool descend)
+{
+    for (size_t i = 1; i < n; i++) {
+        element_t *e = v[i];
+        size_t j = i;
+        for (; j && less(e, v[j - 1], descend); j--)
+            v[j] = v[j - 1];
+        v[j] = e;
+    }
+}
+
+/* Restore the max-heap below @i in the heap of @n elements at @v */
+static void sift(element_t **v, size_t n, size_t i, bool descend)
+{
+    element_t *top = v[i];
+
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= n)
+            break;
+        if (child + 1 < n && less(v[child], v[child + 1], descend))
+            child++;
+        if (!less(top, v[child], descend))
+            break;
+        v[i] = v[child];
+        i = child;
+    }
+    v[i] = top;
+}
+
+static void heap_sort(element_t **v, size_t n, bool descend)
+{
+    for (size_t i = n / 2; i--;)
+        sift(v, n, i, descend);
+    while (n > 1) {
+        swap_elements(&v[0], &v[--n]);
+        sift(v, n, 0, descend);
+    }
+}
+
+/* Sort an array with quicksort, falling back to heap sort once @depth runs
+ * out so that adversarial inputs stay O(n log n). The pivot is the median of
+ * the first, middle and last elements, and the partition stops on elements
+ * equal to it from both sides, which splits runs of equal strings evenly.
+ */
+static void intro_sort(element_t **v, size_t n, int depth, bool descend)
+{
+    while (n > SORT_INSERTION) {
+        if (!depth--) {
+            heap_sort(v, n, descend);
+            return;
+        }
+
+        size_t m = n / 2;
+        if (less(v[m], v[0], descend))
+            swap_elements(&v[m], &v[0]);
+        if (less(v[n - 1], v[0], descend))
+            swap_elements(&v[n - 1], &v[0]);
+        if (less(v[n - 1], v[m], descend))
+            swap_elements(&v[n - 1], &v[m]);
+        swap_elements(&v[0], &v[m]);
+
+        /* v[n - 1] stops the first scan, the pivot in v[0] the second one */
+        element_t *pivot = v[0];
+        size_t i = 0, j = n;
+        for (;;) {
+            while (less(v[++i], pivot, descend))
+                ;
+            while (less(pivot, v[--j], descend))
+                ;
+            if (i >= j)
+                break;
+            swap_elements(&v[i], &v[j]);
+        }
+        swap_elements(&v[0], &v[j]);
+
+        /* Recurse into the shorter side, which bounds the stack depth */
+        if (j < n - j - 1) {
+            intro_sort(v, j, depth, descend);
+            v += j + 1;
+            n -= j + 1;
+        } else {
+            intro_sort(v + j + 1, n - j - 1, depth, descend);
+            n = j;
+        }
+    }
+    insertion_sort(v, n, descend);
+}
+
+static void comparison_sort(element_t **v, size_t n, bool descend)
+{
+    int depth = 0;
+    for (size_t i = n; i > 1; i >>= 1)
+        depth += 2;
+    intro_sort(v, n, depth, descend);
+}
+
+/* Byte @depth of the key of @e */
+static inline int key_byte(const element_t *e, int depth)
+{
+    return (e->key >> (56 - 8 * depth)) & 0xff;
+}
+
+/* Sort an array in place with an MSD radix sort, the array counterpart of
+ * radix_sort(). Elements are counted per byte value at @depth, then moved
+ * into their buckets by following permutation cycles, and each bucket is
+ * sorted on the following byte.
+ */
+static void radix_sort_array(element_t **v, size_t n, int depth, bool descend)
+{
+    if (n < RADIX_CUTOFF || depth == RADIX_MAX_DEPTH) {
+        comparison_sort(v, n, descend);
+        return;
+    }
+
+    size_t count[256] = {0}, next[256], end[256];
+    for (size_t i = 0; i < n; i++)
+        count[key_byte(v[i], depth)]++;
+
+    size_t pos = 0;
+    for (int i = 0; i < 256; i++) {
+        int b = descend ? 255 - i : i;
+        next[b] = pos;
+        pos += count[b];
+        end[b] = pos;
+    }
+
+    for (int i = 0; i < 256; i++) {
+        int b = descend ? 255 - i : i;
+        while (next[b] < end[b]) {
+            element_t *e = v[next[b]];
+            int d;
+            while ((d = key_byte(e, depth)) != b) {
+                element_t *tmp = v[next[d]];
+                v[next[d]++] = e;
+                e = tmp;
+            }
+            v[next[b]++] = e;
+        }
+    }
+
+    /* Strings in bucket 0 ended before @depth, so they are all equal */
+    for (int b = 1; b < 256; b++) {
+        if (count[b] > 1)
+            radix_sort_array(v + end[b] - count[b], count[b], depth + 1,
+                             descend);
+    }
+}
+
+int sort_algo = SORT_MERGE;
+
+/* Sort a list with the algorithm in sort_algo, on the calling thread */
+static void sort_run(sort_run_t *list, bool descend)
+{
+    if (sort_algo == SORT_RADIX)
+        radix_sort(list, 0, descend);
+    else
+        merge_sort(list, descend);
+}
+
+static void sort_slice(element_t **v, size_t n, bool descend)
+{
+    if (sort_algo == SORT_RADIX)
+        radix_sort_array(v, n, 0, descend);
+    else
+        comparison_sort(v, n, descend);
+}
+
+/**
+ * sort_job_t - State of a parallel sort, shared by the tasks
+ * @runs: the sorted segments of a list, merged into @runs[0] in the end
+ * @nruns: number of segments
+ * @step: distance between the segments merged at the current level
+ * @v: the array, for sort_array()
+ * @bounds: the buckets of @v, bucket i runs from @bounds[i] to @bounds[i + 1]
+ * @descend: whether or not to sort in descending order
+ * @pooled: whether the tasks are shared with the workers, or all run on the
+ *          calling thread since another thread has the workers
+ */
+typedef struct {
+    sort_run_t runs[SORT_MAX_THREADS];
+    int nruns, step;
+    element_t **v;
+    size_t bounds[SORT_MAX_THREADS + 1];
+    bool descend;
+    bool pooled;
+} sort_job_t;
+
+/* Worker threads for the parallel sorts. They are started ahead of time by
+ * sort_set_threads() and take their share of the tasks handed out by
+ * pool_run(), so sorting itself neither allocates nor creates threads. The
+ * job of the sort which has them lives here rather than on the stack of the
+ * sorting thread, so that a timeout may unwind that stack while the workers
+ * finish their tasks.
+ */
+static struct {
+    pthread_mutex_t busy;
+    pthread_mutex_t lock;
+    pthread_cond_t work, done;
+    pthread_t threads[SORT_MAX_THREADS - 1];
+    int nthreads;
+    void (*fn)(void *arg, int i);
+    void *arg;
+    int ntasks, next, pending;
+    bool quit;
+    sort_job_t job;
+} pool = {
+    .busy = PTHREAD_MUTEX_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+/* Whether the calling thread holds pool.busy, and runs one of the tasks */
+static __thread volatile sig_atomic_t pool_held = false;
+static __thread volatile sig_atomic_t pool_in_task = false;
+
+/* How long the sorting thread waits for the workers between two chances for
+ * the timer of exception_setup() to fire, in nanoseconds
+ */
+#define POOL_POLL_NS 10000000L
+
+/* Run the tasks not taken yet, with pool.lock held */
+static void pool_take()
+{
+    while (pool.next < pool.ntasks) {
+        int i = pool.next++;
+        pthread_mutex_unlock(&pool.lock);
+        pool.fn(pool.arg, i);
+        pthread_mutex_lock(&pool.lock);
+        if (!--pool.pending)
+            pthread_cond_signal(&pool.done);
+    }
+}
+
+static void *pool_worker(void *unused)
+{
+    pthread_mutex_lock(&pool.lock);
+    while (!pool.quit) {
+        pool_take();
+        if (!pool.quit)
+            pthread_cond_wait(&pool.work, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+
+/* Hold off SIGALRM, the timer of exception_setup(), saving the previous
+ * mask in @saved if non-NULL. A timeout must not unwind the stack while the
+ * state of the pool is half updated or pool.lock is taken.
+ */
+static void block_alarm(sigset_t *saved)
+{
+    sigset_t alarm;
+    sigemptyset(&alarm);
+    sigaddset(&alarm, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &alarm, saved);
+}
+
+/* Take the workers and return the job to fill in, valid until
+ * pool_release(). While another thread has the workers, return @local,
+ * whose tasks all run on the calling thread.
+ */
+static sort_job_t *pool_acquire(sort_job_t *local)
+{
+    sigset_t saved;
+    block_alarm(&saved);
+    pool_held = !pthread_mutex_trylock(&pool.busy);
+    sort_job_t *job = pool_held ? &pool.job : local;
+    *job = (sort_job_t){.pooled = pool_held};
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    return job;
+}
+
+static void pool_release(sort_job_t *job)
+{
+    if (!job->pooled)
+        return;
+
+    sigset_t saved;
+    block_alarm(&saved);
+    pool_held = false;
+    pthread_mutex_unlock(&pool.busy);
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+}
+
+/* Call @fn(@job, i) for i from 0 to @ntasks - 1 on the calling thread and
+ * the workers, and wait for all of them to return. The timer is only held
+ * off while the pool is updated: it may fire during a task of the calling
+ * thread or while it waits for the workers, see pool_abandon().
+ */
+static void pool_run(void (*fn)(void *arg, int i), sort_job_t *job, int ntasks)
+{
+    if (!job->pooled) {
+        for (int i = 0; i < ntasks; i++)
+            fn(job, i);
+        return;
+    }
+
+    sigset_t saved;
+    block_alarm(&saved);
+    pthread_mutex_lock(&pool.lock);
+    pool.fn = fn;
+    pool.arg = job;
+    pool.ntasks = ntasks;
+    pool.next = 0;
+    pool.pending = ntasks;
+    pthread_cond_broadcast(&pool.work);
+
+    while (pool.next < pool.ntasks) {
+        int i = pool.next++;
+        pool_in_task = true;
+        pthread_mutex_unlock(&pool.lock);
+        pthread_sigmask(SIG_SETMASK, &saved, NULL);
+
+        fn(job, i);
+
+        block_alarm(NULL);
+        pthread_mutex_lock(&pool.lock);
+        pool_in_task = false;
+        pool.pending--;
+    }
+
+    while (pool.pending) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += POOL_POLL_NS;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        if (!pthread_cond_timedwait(&pool.done, &pool.lock, &until))
+            continue;
+
+        /* Let a pending alarm in, with the pool in a consistent state */
+        pthread_mutex_unlock(&pool.lock);
+        pthread_sigmask(SIG_SETMASK, &saved, NULL);
+        block_alarm(NULL);
+        pthread_mutex_lock(&pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+}
+
+/* Called by exception_setup() once the stack of a sort has been unwound. If
+ * that sort had the workers, hand out no more of its tasks, wait for the
+ * workers to finish the ones they run and give the workers back.
+ */
+static void pool_abandon()
+{
+    if (!pool_held)
+        return;
+
+    pthread_mutex_lock(&pool.lock);
+    pool.pending -= pool.ntasks - pool.next + pool_in_task;
+    pool.next = pool.ntasks;
+    pool_in_task = false;
+    while (pool.pending)
+        pthread_cond_wait(&pool.done, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+
+    pool_held = false;
+    pthread_mutex_unlock(&pool.busy);
+}
+
+int sort_set_threads(int n)
+{
+    if (n < 1)
+        n = 1;
+    if (n > SORT_MAX_THREADS)
+        n = SORT_MAX_THREADS;
+
+    pthread_mutex_lock(&pool.busy);
+    pthread_mutex_lock(&pool.lock);
+    pool.quit = true;
+    pthread_cond_broadcast(&pool.work);
+    pthread_mutex_unlock(&pool.lock);
+    for (int i = 0; i < pool.nthreads; i++)
+        pthread_join(pool.threads[i], NULL);
+    pool.nthreads = 0;
+    pool.quit = false;
+
+    /* Workers take no signals, they are left to the thread that sorts */
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &saved);
+    while (pool.nthreads < n - 1 &&
+           !pthread_create(&pool.threads[pool.nthreads], NULL, pool_worker,
+                           NULL))
+        pool.nthreads++;
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    pthread_mutex_unlock(&pool.busy);
+
+    set_exception_unwinder(pool_abandon);
+    return pool.nthreads + 1;
+}
+
+/* Number of segments a parallel sort of @len elements is split into, 1 to
+ * stay on the calling thread
+ */
+static int sort_segments(size_t len)
+{
+    return len < SORT_PARALLEL_MIN ? 1 : pool.nthreads + 1;
+}
+
+static void sort_list_task(void *arg, int i)
+{
+    sort_job_t *job = arg;
+    sort_run(&job->runs[i], job->descend);
+}
+
+static void sort_bucket_task(void *arg, int i)
+{
+    sort_job_t *job = arg;
+    sort_slice(job->v + job->bounds[i], job->bounds[i + 1] - job->bounds[i],
+               job->descend);
+}
+
+static void merge_task(void *arg, int i)
+{
+    sort_job_t *job = arg;
+    int a = 2 * job->step * i;
+    merge(&job->runs[a], &job->runs[a + job->step], job->descend);
+}
+
+/* Merge the sorted segments pairwise, the merges of each level of the tree
+ * running in parallel. Segments are merged with their right neighbour, so
+ * a stable sort of each segment gives a stable sort of the whole.
+ */
+static void merge_tree(sort_job_t *job)
+{
+    for (job->step = 1; job->step < job->nruns; job->step *= 2) {
+        int pairs = (job->nruns - job->step + 2 * job->step - 1) /
+                    (2 * job->step);
+        pool_run(merge_task, job, pairs);
+    }
+}
+
+struct list_head *sort_list(struct list_head *first, size_t len, bool descend)
+{
+    sort_run_t list = {first, NULL, len};
+    int nruns = sort_segments(len);
+
+    if (nruns == 1) {
+        sort_run(&list, descend);
+        return list.head;
+    }
+
+    /* Cut the list into segments of about equal length */
+    sort_job_t local, *job = pool_acquire(&local);
+    job->nruns = nruns;
+    job->descend = descend;
+    struct list_head *node = first;
+    for (int i = 0; i < nruns; i++) {
+        sort_run_t *run = &job->runs[i];
+        run->len = len * (i + 1) / nruns - len * i / nruns;
+        run->head = node;
+        for (size_t k = 1; k < run->len; k++)
+            node = node->next;
+        run->tail = node;
+        node = node->next;
+        run->tail->next = NULL;
+    }
+
+    pool_run(sort_list_task, job, nruns);
+    merge_tree(job);
+    struct list_head *sorted = job->runs[0].head;
+    pool_release(job);
+    return sorted;
+}
+
+/* A sorted input of the k-way merge, null-terminated through @next */
+typedef struct {
+    struct list_head *node;
+    int src;
+} merge_src_t;
+
+/* Order heap entries by their head nodes, ties go to the earlier queue */
+static inline bool src_less(const merge_src_t *a,
+                            const merge_src_t *b,
+                            bool descend)
+{
+    int cmp = order(a->node, b->node, descend);
+    return cmp < 0 || (!cmp && a->src < b->src);
+}
+
+static void sift_down(merge_src_t *heap, int n, int i, bool descend)
+{
+    merge_src_t top = heap[i];
+
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= n)
+            break;
+        if (child + 1 < n && src_less(&heap[child + 1], &heap[child], descend))
+            child++;
+        if (!src_less(&heap[child], &top, descend))
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = top;
+}
+
+/* Merge the @n sorted lists in @heap with a binary min-heap keyed on their
+ * head nodes, in O(N log n) comparisons. Return the merged list.
+ */
+static struct list_head *kway_merge(merge_src_t *heap, int n, bool descend)
+{
+    struct list_head *first = NULL, **tail = &first;
+
+    for (int i = n / 2 - 1; i >= 0; i--)
+        sift_down(heap, n, i, descend);
+
+    while (n) {
+        struct list_head *node = heap[0].node;
+        *tail = node;
+        tail = &node->next;
+        if (node->next)
+            heap[0].node = node->next;
+        else
+            heap[0] = heap[--n];
+        sift_down(heap, n, 0, descend);
+    }
+    return first;
+}
+
+struct list_head *merge_lists(struct list_head *lists[], int n, bool descend)
+{
+    merge_src_t heap[MERGE_MAX_WAYS];
+
+    for (int i = 0; i < n; i++) {
+        heap[i].node = lists[i];
+        heap[i].src = i;
+    }
+    return kway_merge(heap, n, descend);
+}
+
+/* Elements sampled per bucket to pick the splitters of sort_array() */
+#define SORT_SAMPLES 16
+
+/* Number of @splitters in front of @e, which is the bucket of @e */
+static int bucket_of(const element_t *e,
+                     element_t *const *splitters,
+                     int n,
+                     bool descend)
+{
+    int lo = 0, hi = n;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (less(splitters[mid], e, descend))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+void sort_array(element_t **v, size_t n, bool descend)
+{
+    int nb = sort_segments(n);
+    if (nb == 1) {
+        sort_slice(v, n, descend);
+        return;
+    }
+
+    /* A sample sort: splitters picked from an evenly spaced sample cut the
+     * array into one bucket per thread, and the buckets are then sorted in
+     * parallel. Unlike lists, arrays need no merging afterwards.
+     */
+    element_t *sample[SORT_MAX_THREADS * SORT_SAMPLES];
+    int ns = nb * SORT_SAMPLES;
+    for (int i = 0; i < ns; i++)
+        sample[i] = v[n / ns * i];
+    comparison_sort(sample, ns, descend);
+    element_t *splitters[SORT_MAX_THREADS - 1];
+    for (int b = 0; b < nb - 1; b++)
+        splitters[b] = sample[(b + 1) * SORT_SAMPLES];
+
+    sort_job_t local, *job = pool_acquire(&local);
+    job->nruns = nb;
+    job->v = v;
+    job->descend = descend;
+    size_t count[SORT_MAX_THREADS] = {0};
+    for (size_t i = 0; i < n; i++)
+        count[bucket_of(v[i], splitters, nb - 1, descend)]++;
+    size_t next[SORT_MAX_THREADS];
+    for (int b = 0; b < nb; b++) {
+        next[b] = job->bounds[b];
+        job->bounds[b + 1] = job->bounds[b] + count[b];
+    }
+
+    /* Move each element into its bucket by following permutation cycles */
+    for (int b = 0; b < nb; b++) {
+        while (next[b] < job->bounds[b + 1]) {
+            element_t *e = v[next[b]];
+            int k = bucket_of(e, splitters, nb - 1, descend);
+            if (k == b) {
+                next[b]++;
+                continue;
+            }
+            v[next[b]] = v[next[k]];
+            v[next[k]++] = e;
+        }
+    }
+
+    pool_run(sort_bucket_task, job, nb);
+    pool_release(job);
+}
@@ -0,0 +1,72 @@
+#ifndef LAB0_SORT_H
+#define LAB0_SORT_H
+
+/* Sorting and merging of queue elements shared by the queue backends.
+ *
+ * The list functions work on null-terminated lists of elements linked
+ * through the @next pointer of their @list member alone; the @prev pointers
+ * are left alone and have to be restored by the caller. sort_array() works
+ * on an array of pointers to elements instead. None of them allocates
+ * memory.
+ *
+ * Inputs of at least SORT_PARALLEL_MIN elements are sorted in parallel once
+ * sort_set_threads() has started worker threads. A list is cut into one
+ * segment per thread, the segments are sorted concurrently, then merged
+ * pairwise in a tree whose levels are merged concurrently as well. An array
+ * is partitioned around sampled splitters into one bucket per thread, and
+ * the buckets are sorted concurrently.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "list.h"
+#include "queue.h"
+
+/* Maximum number of lists merged by one call to merge_lists(). The heap
+ * lives on the stack since q_merge() may not allocate; longer chains are
+ * merged in several passes, each one folding more queues into the first.
+ */
+#define MERGE_MAX_WAYS 256
+
+/* Inputs shorter than this are sorted by the calling thread alone */
+#define SORT_PARALLEL_MIN 32768
+
+/**
+ * sort_list() - Sort a list of elements with the algorithm in sort_algo
+ * @first: first node of the list
+ * @len: number of nodes in the list
+ * @descend: whether or not to sort in descending order
+ *
+ * The sort is stable.
+ *
+ * Return: first node of the sorted list
+ */
+struct list_head *sort_list(struct list_head *first, size_t len, bool descend);
+
+/**
+ * merge_lists() - Merge sorted lists of elements into one
+ * @lists: first nodes of the lists, none of them empty
+ * @n: number of lists, at most MERGE_MAX_WAYS
+ * @descend: whether the lists are sorted in descending order
+ *
+ * Equal elements are taken from the lists in the order they appear in
+ * @lists.
+ *
+ * Return: first node of the merged list
+ */
+struct list_head *merge_lists(struct list_head *lists[], int n, bool descend);
+
+/**
+ * sort_array() - Sort an array of elements in place
+ * @v: the array
+ * @n: number of elements in @v
+ * @descend: whether or not to sort in descending order
+ *
+ * SORT_RADIX selects an MSD radix sort as for lists. Without scratch memory
+ * there is no merge sort here: SORT_MERGE selects an introsort, so unlike
+ * sort_list() this sort is not stable.
+ */
+void sort_array(element_t **v, size_t n, bool descend);
+
+#endif /* LAB0_SORT_H */
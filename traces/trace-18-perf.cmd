@@ -0,0 +1,8 @@
+# Test performance of ascend and descend
+option fail 0
+option malloc 0
+new
+ih dolphin 1000000
+it gerbil 1000000
+ascend
+descend
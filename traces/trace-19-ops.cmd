@@ -0,0 +1,23 @@
+# Test of bulk insert_head, insert_tail, remove_head, and remove_tail
+option fail 0
+option malloc 0
+new
+ih gerbil 3
+it dolphin 4
+ih bear
+it meerkat 2
+rh bear 2
+rt meerkat 3
+size
+rh gerbil 2
+rt dolphin 1
+rh dolphin 5
+it RAND 300
+ih tiger 200
+rh tiger 200
+it zebra
+rt zebra 1
+rh - 150
+rt - 150
+get 0
+size
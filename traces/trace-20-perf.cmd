@@ -0,0 +1,12 @@
+# Test performance of delete_mid
+option fail 0
+option malloc 0
+new
+ih dolphin 500000
+it gerbil 500000
+dm 200000
+ih dolphin 100000
+dm 100000
+rh dolphin 200000
+rt gerbil 200000
+dm 100000
@@ -0,0 +1,36 @@
+# Test of positional access, insert_at, and delete_at
+option fail 0
+option malloc 0
+new
+it gerbil
+it bear
+it dolphin
+get 0 gerbil
+get 2 dolphin
+ia 1 meerkat
+get 1 meerkat
+get 2 bear
+ih tiger
+it vulture
+get 0 tiger
+get 5 vulture
+da 3
+get 3 dolphin
+dm
+get 2 dolphin
+rt vulture
+da 0
+get 0 gerbil
+sort
+get 0 dolphin
+get 1 gerbil
+ia 2 zebra
+get 2 zebra
+it squirrel 1000
+ia 500 fox
+get 500 fox
+da 500
+get 500 squirrel
+reverse
+get 1002 dolphin
+get 0 squirrel
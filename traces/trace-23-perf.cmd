@@ -0,0 +1,36 @@
+# Test of sort split over several threads, above and below the size where it
+# goes parallel
+option fail 0
+option malloc 0
+option threads 4
+new
+ih RAND 200000
+sort
+reverse
+sort
+option descend 1
+sort
+option descend 0
+free
+new
+ih RAND 1000
+sort
+free
+new
+ih dolphin 300000
+it gerbil 300000
+it bear 100000
+sort
+option sortalgo 1
+ih RAND 100000
+sort
+option descend 1
+sort
+option descend 0
+option sortalgo 0
+option threads 1
+sort
+option threads 3
+reverse
+sort
+free
@@ -0,0 +1,46 @@
+# Test of dedup all, which removes repeated strings anywhere in the queue
+option fail 0
+option malloc 0
+new
+ih gerbil
+it bear
+it dolphin
+it gerbil
+it meerkat
+it bear
+it bear
+it squirrel
+dedup all
+rh dolphin
+rh meerkat
+rh squirrel
+it vulture
+it vulture
+dedup all
+get 0
+ih a
+it b
+it c
+dedup all
+rh a
+rh b
+rh c
+ih aardvark_the_long_one
+it aardvark_the_long_two
+it aardvark_the_long_one
+it aardvark_the_long_three
+it aardvark_the_short
+dedup all
+rh aardvark_the_long_two
+rh aardvark_the_long_three
+rh aardvark_the_short
+option intern 1
+ih lion
+it tiger
+it lion
+it zebra
+dedup all
+rh tiger
+rh zebra
+option intern 0
+free
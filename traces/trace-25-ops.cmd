@@ -0,0 +1,36 @@
+# Test of freeing queues on the reclaimer thread
+option fail 0
+option malloc 0
+option async 1
+new
+it gerbil 1000
+new
+ih bear 200000
+it dolphin
+new
+it meerkat 10
+prev
+rt dolphin
+free
+rh meerkat
+free
+rh gerbil
+new
+ih tiger 5
+reverse
+free
+free
+new
+option intern 1
+ih lion 3
+free
+option intern 0
+new
+it zebra 50000
+option async 0
+free
+option async 1
+new
+it squirrel 3
+new
+it vulture 300000
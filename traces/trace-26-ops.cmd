@@ -0,0 +1,45 @@
+# Test of save and load, which round-trip a queue through a binary file
+option fail 0
+option malloc 0
+new
+it gerbil
+it bear
+it the_longest_dolphin_in_the_sea
+it bear
+ih meerkat
+save
+new
+load
+get 4 bear
+get 5
+rh meerkat
+rh gerbil
+rh bear
+rh the_longest_dolphin_in_the_sea
+rh bear
+it squirrel
+load
+get 5 bear
+get 6
+rh squirrel
+rt bear
+free
+new
+save
+it vulture
+load
+get 0 vulture
+get 1
+rh vulture
+ih RAND 50000
+save
+new
+load
+get 49999
+get 50000
+sort
+prev
+sort
+free
+free
+free
@@ -0,0 +1,51 @@
+# Test of the string pool, mixed with inline and interned strings
+option fail 0
+option malloc 0
+option pool 1
+new
+it gerbil
+it bear
+ih the_longest_dolphin_in_the_sea
+it meerkat 3
+rh the_longest_dolphin_in_the_sea
+compact
+rt meerkat
+option pool 0
+it squirrel
+option intern 1
+it vulture
+option intern 0
+option pool 1
+it bear
+sort
+rh bear
+rh bear
+rh gerbil
+rh meerkat
+rh meerkat
+rh squirrel
+rh vulture
+get 0
+it tiger 100
+new
+it lion 50
+ih RAND 1000
+sort
+prev
+dedup all
+get 0
+compact
+merge
+get 1049
+get 1050
+compact
+sort
+dedup
+compact
+free
+new
+it zebra 100000
+ih RAND 100000
+sort
+compact
+free
@@ -0,0 +1,35 @@
+# Test of merge into a queue emptied by remove and dedup all
+option fail 0
+option malloc 0
+new
+it bear
+it gerbil
+rh bear
+rh gerbil
+new
+ia 0 dolphin
+ia 1 meerkat
+new
+it tiger
+merge
+get 0 dolphin
+get 1 meerkat
+get 2 tiger
+get 3
+rh dolphin
+rh meerkat
+rh tiger
+ih vulture 6
+dedup all
+get 0
+new
+it bear
+it zebra
+new
+it gerbil
+merge
+get 0 bear
+get 1 gerbil
+get 2 zebra
+get 3
+free